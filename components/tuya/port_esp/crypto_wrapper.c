@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "tuya_error_code.h"
+#include "crypto_interface.h"
+#include "aes_inf.h"
+#include "esp_log.h"
+
+#if CONFIG_MBEDTLS_HARDWARE_AES
+#include "aes/esp_aes.h"
+
+static const char *TAG = "tuya_crypto_wrapper";
+
+static void esp_aes128_ecb(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *out, int mode)
+{
+    esp_aes_context ctx;
+    UINT_T i;
+
+    esp_aes_init(&ctx);
+    esp_aes_setkey(&ctx, key, 128);
+    for (i = 0; i < len; i += 16)
+    {
+        esp_aes_crypt_ecb(&ctx, mode, data + i, out + i);
+    }
+    esp_aes_free(&ctx);
+}
+
+static void esp_aes128_cbc(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *iv, uint8_t *out, int mode)
+{
+    esp_aes_context ctx;
+
+    esp_aes_init(&ctx);
+    esp_aes_setkey(&ctx, key, 128);
+    esp_aes_crypt_cbc(&ctx, mode, len, iv, data, out);
+    esp_aes_free(&ctx);
+}
+
+static void esp_aes128_ecb_enc(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *ec_data)
+{
+    esp_aes128_ecb(data, len, key, ec_data, ESP_AES_ENCRYPT);
+}
+
+static void esp_aes128_ecb_dec(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *dec_data)
+{
+    esp_aes128_ecb(data, len, key, dec_data, ESP_AES_DECRYPT);
+}
+
+static void esp_aes128_cbc_enc(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *iv, uint8_t *ec_data)
+{
+    esp_aes128_cbc(data, len, key, iv, ec_data, ESP_AES_ENCRYPT);
+}
+
+static void esp_aes128_cbc_dec(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *iv, uint8_t *dec_data)
+{
+    esp_aes128_cbc(data, len, key, iv, dec_data, ESP_AES_DECRYPT);
+}
+
+int crypto_aes_init(void)
+{
+    /* Only the AES-128 entries are hooked, AES-192/256 stay on the software path */
+    AES_METHOD_REG_S method = {
+        .ecb_enc_128 = esp_aes128_ecb_enc,
+        .ecb_dec_128 = esp_aes128_ecb_dec,
+        .cbc_enc_128 = esp_aes128_cbc_enc,
+        .cbc_dec_128 = esp_aes128_cbc_dec,
+    };
+
+    ESP_LOGI(TAG, "AES-128 using hardware accelerator");
+    return aes_method_register(&method, NULL);
+}
+
+#else
+
+int crypto_aes_init(void)
+{
+    /* No AES peripheral enabled, keep the SDK software AES */
+    return OPRT_OK;
+}
+
+#endif
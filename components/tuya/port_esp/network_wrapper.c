@@ -1,9 +1,13 @@
 #include <stdbool.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "log.h"
 #include "tuya_error_code.h"
 #include "network_interface.h"
 #include "system_interface.h"
+#include "storage_interface.h"
+#include "crc32.h"
 #include "mbedtls/platform.h"
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/ssl.h"
@@ -13,6 +17,7 @@
 #include "mbedtls/debug.h"
 #include "mbedtls/timing.h"
 #include "esp_log.h"
+#include "lwip/sockets.h"
 
 struct tls_context
 {
@@ -25,8 +30,34 @@ struct tls_context
 	uint32_t flags;
 };
 
+/* Number of endpoints whose TLS session is kept for resumption */
+#ifndef TLS_SESSION_CACHE_MAX
+#define TLS_SESSION_CACHE_MAX 4
+#endif
+
+#define TLS_SESSION_HOST_MAX 64
+
+/* Also keep sessions in local_storage so they survive a reboot */
+#ifndef TLS_SESSION_PERSIST
+#define TLS_SESSION_PERSIST 0
+#endif
+
+#define TLS_SESSION_PERSIST_MAX 2048
+
+typedef struct
+{
+	char host[TLS_SESSION_HOST_MAX];
+	uint16_t port;
+	bool valid;
+	uint32_t stored_crc;
+	mbedtls_ssl_session session;
+} tls_session_cache_t;
+
 static const char *TAG = "tuya_network_wrapper";
 
+static tls_session_cache_t s_session_cache[TLS_SESSION_CACHE_MAX];
+static uint8_t s_session_cache_next;
+
 static int mbedtls_random_port(void *p_rng, unsigned char *output, size_t output_len)
 {
 	int i = 0;
@@ -39,6 +70,133 @@ static int mbedtls_random_port(void *p_rng, unsigned char *output, size_t output
 	return 0;
 }
 
+#if TLS_SESSION_PERSIST
+static void tls_session_storage_key(const char *host, uint16_t port, char *key)
+{
+	char endpoint[TLS_SESSION_HOST_MAX + 8];
+	snprintf(endpoint, sizeof(endpoint), "%s:%d", host, port);
+	snprintf(key, 16, "tls_%08x", (unsigned int)crc_32((const unsigned char *)endpoint, strlen(endpoint)));
+}
+
+static void tls_session_storage_load(tls_session_cache_t *entry)
+{
+	char key[16];
+	size_t length = TLS_SESSION_PERSIST_MAX;
+	uint8_t *buffer = system_malloc(TLS_SESSION_PERSIST_MAX);
+
+	if (NULL == buffer)
+	{
+		return;
+	}
+
+	tls_session_storage_key(entry->host, entry->port, key);
+	if (local_storage_get(key, buffer, &length) == OPRT_OK &&
+		mbedtls_ssl_session_load(&entry->session, buffer, length) == 0)
+	{
+		ESP_LOGD(TAG, "tls session loaded from storage");
+		entry->valid = true;
+		entry->stored_crc = crc_32(buffer, length);
+	}
+	system_free(buffer);
+}
+
+static void tls_session_storage_save(tls_session_cache_t *entry)
+{
+	char key[16];
+	size_t length = 0;
+	uint32_t crc = 0;
+	uint8_t *buffer = NULL;
+
+	mbedtls_ssl_session_save(&entry->session, NULL, 0, &length);
+	if (0 == length || length > TLS_SESSION_PERSIST_MAX)
+	{
+		return;
+	}
+
+	buffer = system_malloc(length);
+	if (NULL == buffer)
+	{
+		return;
+	}
+
+	/* Rewrite storage only when the session changed, a resumed connect keeps the flash quiet */
+	tls_session_storage_key(entry->host, entry->port, key);
+	if (mbedtls_ssl_session_save(&entry->session, buffer, length, &length) == 0)
+	{
+		crc = crc_32(buffer, length);
+		if (crc != entry->stored_crc && local_storage_set(key, buffer, length) == OPRT_OK)
+		{
+			entry->stored_crc = crc;
+		}
+	}
+	system_free(buffer);
+}
+#endif
+
+/* Find the cached session of an endpoint, or take a slot for it */
+static tls_session_cache_t *tls_session_cache_find(const char *host, uint16_t port)
+{
+	tls_session_cache_t *entry = NULL;
+	int i;
+
+	if (strlen(host) >= TLS_SESSION_HOST_MAX)
+	{
+		return NULL;
+	}
+
+	for (i = 0; i < TLS_SESSION_CACHE_MAX; i++)
+	{
+		if (s_session_cache[i].port == port && strcmp(s_session_cache[i].host, host) == 0)
+		{
+			return &s_session_cache[i];
+		}
+	}
+
+	/* Round robin replacement */
+	entry = &s_session_cache[s_session_cache_next];
+	s_session_cache_next = (s_session_cache_next + 1) % TLS_SESSION_CACHE_MAX;
+
+	if (entry->valid)
+	{
+		mbedtls_ssl_session_free(&entry->session);
+	}
+	memset(entry, 0, sizeof(tls_session_cache_t));
+	mbedtls_ssl_session_init(&entry->session);
+	strcpy(entry->host, host);
+	entry->port = port;
+
+#if TLS_SESSION_PERSIST
+	tls_session_storage_load(entry);
+#endif
+
+	return entry;
+}
+
+static void tls_session_cache_invalidate(tls_session_cache_t *entry)
+{
+	if (entry && entry->valid)
+	{
+		mbedtls_ssl_session_free(&entry->session);
+		mbedtls_ssl_session_init(&entry->session);
+		entry->valid = false;
+	}
+}
+
+/* Remember the negotiated session so the next connect can resume it */
+static void tls_session_cache_store(tls_session_cache_t *entry, const mbedtls_ssl_context *ssl)
+{
+	tls_session_cache_invalidate(entry);
+	if (mbedtls_ssl_get_session(ssl, &entry->session) != 0)
+	{
+		return;
+	}
+	entry->valid = true;
+
+#if TLS_SESSION_PERSIST
+	tls_session_storage_save(entry);
+#endif
+}
+
 int network_tls_init(NetworkContext_t *pNetwork, const TLSConnectParams *params)
 {
 	if (NULL == pNetwork)
@@ -63,6 +221,8 @@ int network_tls_init(NetworkContext_t *pNetwork, const TLSConnectParams *params)
 	}
 
 	tls_ctx->flags = 0;
+	/* No socket until connected, network_tls_wait checks the fd */
+	mbedtls_net_init(&tls_ctx->server_fd);
 	pNetwork->context = tls_ctx;
 
 	return OPRT_OK;
@@ -72,6 +232,7 @@ int network_tls_connect(NetworkContext_t *pNetwork, const TLSConnectParams *para
 {
 	int ret = 0;
 	tls_context_t *tlsDataParams = NULL;
+	tls_session_cache_t *session = NULL;
 	char portBuffer[6];
 
 	if (NULL == pNetwork)
@@ -224,6 +385,18 @@ int network_tls_connect(NetworkContext_t *pNetwork, const TLSConnectParams *para
 		return OPRT_MID_TLS_CONNECTION_ERROR;
 	}
 
+	/* Offer the last session of this endpoint for an abbreviated handshake */
+	session = tls_session_cache_find(pNetwork->tlsConnectParams.host, pNetwork->tlsConnectParams.port);
+	if (session && session->valid)
+	{
+		ESP_LOGD(TAG, "resuming cached TLS session...");
+		if ((ret = mbedtls_ssl_set_session(&(tlsDataParams->ssl), &session->session)) != 0)
+		{
+			ESP_LOGW(TAG, "mbedtls_ssl_set_session returned -0x%x", -ret);
+			tls_session_cache_invalidate(session);
+		}
+	}
+
 	ESP_LOGD(TAG, "performing the SSL/TLS handshake...");
 
 	while ((ret = mbedtls_ssl_handshake(&(tlsDataParams->ssl))) != 0)
@@ -243,12 +416,17 @@ int network_tls_connect(NetworkContext_t *pNetwork, const TLSConnectParams *para
 			}
 
 			mbedtls_x509_crt_free(&(tlsDataParams->cacert));
+			tls_session_cache_invalidate(session);
 
 			return OPRT_MID_TLS_CONNECTION_ERROR;
 		}
 	}
 
 	ESP_LOGD(TAG, "TLS handshake complete.");
+	if (session)
+	{
+		tls_session_cache_store(session, &(tlsDataParams->ssl));
+	}
 	ESP_LOGD(TAG, "release CA x509 parse.");
 
 	mbedtls_x509_crt_free(&(tlsDataParams->cacert));
@@ -341,3 +519,104 @@ int network_tls_read(NetworkContext_t *pNetwork, unsigned char *pMsg, size_t len
 
 	return rv;
 }
+
+/* Loopback UDP pair, a datagram on it ends network_tls_wait early */
+static int s_wake_rx = -1;
+static int s_wake_tx = -1;
+static struct sockaddr_in s_wake_addr;
+
+static int network_wake_init(void)
+{
+	socklen_t len = sizeof(s_wake_addr);
+	int rx = socket(AF_INET, SOCK_DGRAM, 0);
+	int tx = socket(AF_INET, SOCK_DGRAM, 0);
+
+	memset(&s_wake_addr, 0, sizeof(s_wake_addr));
+	s_wake_addr.sin_family = AF_INET;
+	s_wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (rx < 0 || tx < 0 ||
+		bind(rx, (struct sockaddr *)&s_wake_addr, sizeof(s_wake_addr)) != 0 ||
+		getsockname(rx, (struct sockaddr *)&s_wake_addr, &len) != 0)
+	{
+		ESP_LOGE(TAG, "wake socket init failed");
+		if (rx >= 0)
+		{
+			close(rx);
+		}
+		if (tx >= 0)
+		{
+			close(tx);
+		}
+		return OPRT_COM_ERROR;
+	}
+
+	fcntl(rx, F_SETFL, O_NONBLOCK);
+	s_wake_rx = rx;
+	s_wake_tx = tx;
+	return OPRT_OK;
+}
+
+void network_wakeup(void)
+{
+	if (s_wake_tx >= 0)
+	{
+		sendto(s_wake_tx, "w", 1, 0, (struct sockaddr *)&s_wake_addr, sizeof(s_wake_addr));
+	}
+}
+
+int network_tls_wait(NetworkContext_t *pNetwork, uint32_t timeout_ms)
+{
+	tls_context_t *tlsDataParams = pNetwork ? (tls_context_t *)(pNetwork->context) : NULL;
+	int fd = tlsDataParams ? tlsDataParams->server_fd.fd : -1;
+	char drain[8];
+	fd_set readfds;
+	int maxfd = -1;
+
+	/* Records already decrypted or buffered by mbedTLS never show on the socket */
+	if (fd >= 0 &&
+		(mbedtls_ssl_get_bytes_avail(&tlsDataParams->ssl) > 0 || mbedtls_ssl_check_pending(&tlsDataParams->ssl)))
+	{
+		return 1;
+	}
+
+	if (s_wake_rx < 0)
+	{
+		network_wake_init();
+	}
+
+	FD_ZERO(&readfds);
+	if (fd >= 0)
+	{
+		FD_SET(fd, &readfds);
+		maxfd = fd;
+	}
+	/* A zero timeout only polls the connection, a pending wakeup is kept for the next wait */
+	if (s_wake_rx >= 0 && timeout_ms)
+	{
+		FD_SET(s_wake_rx, &readfds);
+		maxfd = s_wake_rx > maxfd ? s_wake_rx : maxfd;
+	}
+	if (maxfd < 0)
+	{
+		system_sleep(timeout_ms);
+		return 0;
+	}
+
+	struct timeval tv = {
+		.tv_sec = timeout_ms / 1000,
+		.tv_usec = (timeout_ms % 1000) * 1000,
+	};
+	if (select(maxfd + 1, &readfds, NULL, NULL, &tv) <= 0)
+	{
+		return 0;
+	}
+
+	if (s_wake_rx >= 0 && FD_ISSET(s_wake_rx, &readfds))
+	{
+		while (recv(s_wake_rx, drain, sizeof(drain), 0) > 0)
+		{
+		}
+	}
+
+	return fd >= 0 && FD_ISSET(fd, &readfds) ? 1 : 0;
+}
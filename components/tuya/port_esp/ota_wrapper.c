@@ -0,0 +1,316 @@
+#include <stdint.h>
+#include <string.h>
+#include "tuya_error_code.h"
+#include "ota_interface.h"
+#include "system_interface.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+
+/* One flash sector per buffer, so every write erases and programs a whole sector */
+#define OTA_WRITE_BUFFER_SIZE (4096)
+#define OTA_WRITE_BUFFER_NUM (2)
+#define OTA_WRITE_TASK_STACK (3 * 1024)
+
+/* Write queue marker, wakes ota_sink_sync once everything queued before it is in flash */
+#define OTA_WRITE_SYNC (0xFF)
+
+static const char *TAG = "tuya_ota_wrapper";
+
+typedef struct
+{
+    uint8_t index;
+    size_t offset;
+    size_t len;
+} ota_write_block_t;
+
+typedef struct
+{
+    const esp_partition_t *partition;
+    size_t offset;
+    uint8_t *buffer[OTA_WRITE_BUFFER_NUM];
+    uint8_t current;
+    size_t fill;
+    QueueHandle_t free_queue;
+    QueueHandle_t write_queue;
+    SemaphoreHandle_t done;
+    volatile esp_err_t err;
+} ota_sink_t;
+
+/* Drains full buffers into flash while the caller keeps fetching the next ranges */
+static void ota_sink_write_task(void *pvParameters)
+{
+    ota_sink_t *sink = (ota_sink_t *)pvParameters;
+    ota_write_block_t block;
+
+    for (;;)
+    {
+        xQueueReceive(sink->write_queue, &block, portMAX_DELAY);
+        if (block.index == OTA_WRITE_SYNC)
+        {
+            xSemaphoreGive(sink->done);
+            continue;
+        }
+        if (block.len == 0)
+        {
+            break;
+        }
+
+        /* Blocks start on a sector boundary, erase exactly the sectors they cover */
+        if (sink->err == ESP_OK)
+        {
+            size_t erase_len = (block.len + OTA_WRITE_BUFFER_SIZE - 1) & ~(OTA_WRITE_BUFFER_SIZE - 1);
+            esp_err_t err = esp_partition_erase_range(sink->partition, block.offset, erase_len);
+            if (err == ESP_OK)
+            {
+                err = esp_partition_write(sink->partition, block.offset, sink->buffer[block.index], block.len);
+            }
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "write 0x%x failed: %s", block.offset, esp_err_to_name(err));
+                sink->err = err;
+            }
+        }
+        xQueueSend(sink->free_queue, &block.index, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(sink->done);
+    vTaskDelete(NULL);
+}
+
+static void ota_sink_block_queue(ota_sink_t *sink)
+{
+    size_t len = sink->fill;
+
+    /* Encrypted partitions are written in whole 16 byte blocks */
+    if (sink->partition->encrypted && (len & 15))
+    {
+        memset(sink->buffer[sink->current] + len, 0xFF, 16 - (len & 15));
+        len = (len + 15) & ~15;
+    }
+
+    ota_write_block_t block = {.index = sink->current, .offset = sink->offset, .len = len};
+    xQueueSend(sink->write_queue, &block, portMAX_DELAY);
+    sink->offset += sink->fill;
+    sink->fill = 0;
+}
+
+static void ota_sink_write_task_stop(ota_sink_t *sink)
+{
+    ota_write_block_t block = {.index = 0, .offset = 0, .len = 0};
+    xQueueSend(sink->write_queue, &block, portMAX_DELAY);
+    xSemaphoreTake(sink->done, portMAX_DELAY);
+}
+
+static void ota_sink_free(ota_sink_t *sink)
+{
+    int i;
+    for (i = 0; i < OTA_WRITE_BUFFER_NUM; i++)
+    {
+        if (sink->buffer[i])
+        {
+            system_free(sink->buffer[i]);
+        }
+    }
+    if (sink->free_queue)
+    {
+        vQueueDelete(sink->free_queue);
+    }
+    if (sink->write_queue)
+    {
+        vQueueDelete(sink->write_queue);
+    }
+    if (sink->done)
+    {
+        vSemaphoreDelete(sink->done);
+    }
+    system_free(sink);
+}
+
+int ota_sink_begin(size_t image_size, size_t offset, void **handle)
+{
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (partition == NULL)
+    {
+        ESP_LOGE(TAG, "no ota partition");
+        return OPRT_COM_ERROR;
+    }
+
+    if (image_size > partition->size)
+    {
+        ESP_LOGE(TAG, "image size %d over partition size %ld", image_size, partition->size);
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    if (offset % OTA_WRITE_BUFFER_SIZE || offset > image_size)
+    {
+        ESP_LOGE(TAG, "invalid resume offset %d", offset);
+        return OPRT_INVALID_PARM;
+    }
+
+    ota_sink_t *sink = system_calloc(1, sizeof(ota_sink_t));
+    if (sink == NULL)
+    {
+        return OPRT_MALLOC_FAILED;
+    }
+    sink->partition = partition;
+    sink->offset = offset;
+
+    int i;
+    sink->free_queue = xQueueCreate(OTA_WRITE_BUFFER_NUM, sizeof(uint8_t));
+    sink->write_queue = xQueueCreate(OTA_WRITE_BUFFER_NUM + 1, sizeof(ota_write_block_t));
+    sink->done = xSemaphoreCreateBinary();
+    if (sink->free_queue == NULL || sink->write_queue == NULL || sink->done == NULL)
+    {
+        ota_sink_free(sink);
+        return OPRT_MALLOC_FAILED;
+    }
+
+    for (i = 0; i < OTA_WRITE_BUFFER_NUM; i++)
+    {
+        sink->buffer[i] = system_malloc(OTA_WRITE_BUFFER_SIZE);
+        if (sink->buffer[i] == NULL)
+        {
+            ota_sink_free(sink);
+            return OPRT_MALLOC_FAILED;
+        }
+    }
+    for (i = 1; i < OTA_WRITE_BUFFER_NUM; i++)
+    {
+        uint8_t index = i;
+        xQueueSend(sink->free_queue, &index, 0);
+    }
+    sink->current = 0;
+
+    /* Sectors are erased one by one in the write task, not the whole partition here */
+    if (xTaskCreate(ota_sink_write_task, "tuya_ota_write", OTA_WRITE_TASK_STACK, sink, uxTaskPriorityGet(NULL), NULL) != pdPASS)
+    {
+        ota_sink_free(sink);
+        return OPRT_MALLOC_FAILED;
+    }
+
+    ESP_LOGI(TAG, "writing %d bytes from 0x%x to partition %s at 0x%lx", image_size, offset, partition->label, partition->address);
+    *handle = sink;
+    return OPRT_OK;
+}
+
+int ota_sink_write(void *handle, const uint8_t *data, size_t len)
+{
+    ota_sink_t *sink = (ota_sink_t *)handle;
+
+    if (sink == NULL || data == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+
+    while (len > 0)
+    {
+        if (sink->err != ESP_OK)
+        {
+            return OPRT_COM_ERROR;
+        }
+
+        size_t copy = OTA_WRITE_BUFFER_SIZE - sink->fill;
+        copy = copy > len ? len : copy;
+        memcpy(sink->buffer[sink->current] + sink->fill, data, copy);
+        sink->fill += copy;
+        data += copy;
+        len -= copy;
+
+        if (sink->fill == OTA_WRITE_BUFFER_SIZE)
+        {
+            ota_sink_block_queue(sink);
+            /* Only blocks when the flash is a whole buffer behind */
+            xQueueReceive(sink->free_queue, &sink->current, portMAX_DELAY);
+        }
+    }
+
+    return OPRT_OK;
+}
+
+int ota_sink_sync(void *handle)
+{
+    ota_sink_t *sink = (ota_sink_t *)handle;
+
+    if (sink == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+
+    ota_write_block_t block = {.index = OTA_WRITE_SYNC, .offset = 0, .len = 0};
+    xQueueSend(sink->write_queue, &block, portMAX_DELAY);
+    xSemaphoreTake(sink->done, portMAX_DELAY);
+
+    return sink->err == ESP_OK ? OPRT_OK : OPRT_COM_ERROR;
+}
+
+int ota_sink_finish(void *handle)
+{
+    ota_sink_t *sink = (ota_sink_t *)handle;
+
+    if (sink == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (sink->fill > 0)
+    {
+        ota_sink_block_queue(sink);
+    }
+    ota_sink_write_task_stop(sink);
+
+    if (sink->err != ESP_OK)
+    {
+        ota_sink_free(sink);
+        return OPRT_COM_ERROR;
+    }
+
+    /* Validates the image header, segments and checksum before switching */
+    esp_err_t err = esp_ota_set_boot_partition(sink->partition);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        ota_sink_free(sink);
+        return OPRT_COM_ERROR;
+    }
+
+    ESP_LOGI(TAG, "next boot partition: %s", sink->partition->label);
+    ota_sink_free(sink);
+    return OPRT_OK;
+}
+
+int ota_sink_abort(void *handle)
+{
+    ota_sink_t *sink = (ota_sink_t *)handle;
+
+    if (sink == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+
+    ota_sink_write_task_stop(sink);
+    ota_sink_free(sink);
+    return OPRT_OK;
+}
+
+int ota_source_read(size_t offset, uint8_t *buffer, size_t len)
+{
+    const esp_partition_t *partition = esp_ota_get_running_partition();
+    if (partition == NULL || buffer == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+
+    /* Decrypts transparently when flash encryption is on */
+    esp_err_t err = esp_partition_read(partition, offset, buffer, len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "read 0x%x failed: %s", offset, esp_err_to_name(err));
+        return OPRT_COM_ERROR;
+    }
+    return OPRT_OK;
+}
@@ -49,3 +49,8 @@ uint32_t system_random(void)
 {
     return (uint32_t)(0xffffffff & rand());
 }
+
+void *system_thread_self(void)
+{
+    return xTaskGetCurrentTaskHandle();
+}
@@ -0,0 +1,154 @@
+/*
+ * Host check of the OTA image pipeline against tools/ota_image.py: the
+ * downloaded file is LZSS decoded if it is compressed, then patched
+ * against the old image if one is given, like tuya_ota does, and the
+ * result compared with the expected image. Input is fed in uneven pieces
+ * to cross every record boundary.
+ *
+ * usage: ota_image_check <ota file> <expected image> [old image]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tuya_error_code.h"
+#include "tuya_ota.h"
+#include "lzss_decoder.h"
+#include "ota_delta.h"
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+} image_file_t;
+
+typedef struct {
+    const image_file_t* expect;
+    size_t total;
+    ota_delta_t patch;
+    bool delta;
+} image_check_t;
+
+/* The running firmware of the delta, stands in for the platform's ota_source_read */
+static image_file_t s_source;
+
+int ota_source_read(size_t offset, uint8_t* buffer, size_t len)
+{
+    if (offset > s_source.len || len > s_source.len - offset) {
+        return OPRT_INDEX_OUT_OF_BOUND;
+    }
+    memcpy(buffer, s_source.data + offset, len);
+    return OPRT_OK;
+}
+
+static int image_file_read(const char* path, image_file_t* file)
+{
+    FILE* fptr = fopen(path, "rb");
+    if (fptr == NULL) {
+        printf("open %s error\n", path);
+        return -1;
+    }
+    fseek(fptr, 0, SEEK_END);
+    file->len = ftell(fptr);
+    fseek(fptr, 0, SEEK_SET);
+    file->data = malloc(file->len ? file->len : 1);
+    if (file->data == NULL || fread(file->data, 1, file->len, fptr) != file->len) {
+        printf("read %s error\n", path);
+        fclose(fptr);
+        return -1;
+    }
+    fclose(fptr);
+    return 0;
+}
+
+/* Compares the rebuilt image as it streams out */
+static int image_check_output(const uint8_t* data, size_t len, void* user_data)
+{
+    image_check_t* check = (image_check_t*)user_data;
+
+    if (len > check->expect->len - check->total ||
+        memcmp(check->expect->data + check->total, data, len) != 0) {
+        printf("output differs from the expected image at or after %u\n", (unsigned)check->total);
+        return OPRT_COM_ERROR;
+    }
+    check->total += len;
+    return OPRT_OK;
+}
+
+static int image_check_patch(const uint8_t* data, size_t len, void* user_data)
+{
+    image_check_t* check = (image_check_t*)user_data;
+
+    if (check->delta) {
+        return ota_delta_feed(&check->patch, data, len);
+    }
+    return image_check_output(data, len, check);
+}
+
+int main(int argc, char** argv)
+{
+    static const size_t pieces[] = {1, 7, 12, 333, 1024, 5};
+    image_file_t ota, expect;
+    image_check_t check = {.expect = &expect};
+    lzss_decoder_t decoder = {0};
+    bool compressed;
+    size_t image_size = 0;
+    size_t offset = 0;
+    size_t i = 0;
+    int rt = OPRT_OK;
+
+    if (argc < 3) {
+        printf("usage: %s <ota file> <expected image> [old image]\n", argv[0]);
+        return 2;
+    }
+    if (image_file_read(argv[1], &ota) != 0 || image_file_read(argv[2], &expect) != 0 ||
+        (argc > 3 && image_file_read(argv[3], &s_source) != 0)) {
+        return 2;
+    }
+
+    check.delta = argc > 3;
+    if (check.delta && ota_delta_init(&check.patch, image_check_output, &check) != OPRT_OK) {
+        return 2;
+    }
+
+    compressed = ota.len >= TUYA_OTA_LZSS_HEADER_LEN && memcmp(ota.data, TUYA_OTA_LZSS_MAGIC, 4) == 0;
+    if (compressed) {
+        const tuya_ota_lzss_header_t* header = (const tuya_ota_lzss_header_t*)ota.data;
+        image_size = header->image_size[0] | header->image_size[1] << 8 |
+                     header->image_size[2] << 16 | (uint32_t)header->image_size[3] << 24;
+        rt = lzss_decoder_init(&decoder, header->window_sz2, header->lookahead_sz2);
+        offset = TUYA_OTA_LZSS_HEADER_LEN;
+    }
+
+    while (rt == OPRT_OK && offset < ota.len) {
+        size_t len = pieces[i++ % (sizeof(pieces) / sizeof(pieces[0]))];
+        len = len > ota.len - offset ? ota.len - offset : len;
+        if (compressed) {
+            rt = lzss_decoder_feed(&decoder, ota.data + offset, len, image_check_patch, &check);
+        } else {
+            rt = image_check_patch(ota.data + offset, len, &check);
+        }
+        offset += len;
+    }
+
+    if (rt == OPRT_OK && compressed && decoder.total != image_size) {
+        printf("decompressed %u of %u bytes\n", (unsigned)decoder.total, (unsigned)image_size);
+        rt = OPRT_COM_ERROR;
+    }
+    if (rt == OPRT_OK && check.delta && check.patch.total != check.patch.image_size) {
+        printf("patched %u of %u bytes\n", (unsigned)check.patch.total, (unsigned)check.patch.image_size);
+        rt = OPRT_COM_ERROR;
+    }
+    if (rt == OPRT_OK && check.total != expect.len) {
+        printf("rebuilt %u of %u bytes\n", (unsigned)check.total, (unsigned)expect.len);
+        rt = OPRT_COM_ERROR;
+    }
+
+    lzss_decoder_free(&decoder);
+    ota_delta_free(&check.patch);
+    free(s_source.data);
+    free(expect.data);
+    free(ota.data);
+    printf("%s: %s\n", argv[1], rt == OPRT_OK ? "ok" : "FAILED");
+    return rt == OPRT_OK ? 0 : 1;
+}
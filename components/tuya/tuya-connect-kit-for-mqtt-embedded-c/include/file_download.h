@@ -7,6 +7,7 @@ extern "C" {
 
 #include <stdint.h>
 #include <stddef.h>
+#include "tuya_config_defaults.h"
 #include "matop_service.h"
 #include "MultiTimer.h"
 
@@ -34,6 +35,8 @@ typedef struct {
     size_t data_len;
     size_t offset;
     size_t file_size;
+    size_t range_length;
+    uint32_t rate;
     void* user_data;
 } file_download_event_t;
 
@@ -43,19 +46,50 @@ typedef void (*file_download_event_cb_t)(file_download_context_t* ctx, file_down
 
 typedef struct {
     char* url;
+    char* https_url;
+    const uint8_t* cacert;
+    size_t cacert_len;
     size_t file_size;
+    size_t offset;
     size_t range_length;
+    uint8_t window_size;
     uint32_t timeout_ms;
     matop_context_t* transport;
     file_download_event_cb_t event_handler;
     void* user_data;
 } file_download_config_t;
 
+typedef struct {
+    file_download_context_t* ctx;
+    size_t offset;
+    size_t length;
+    uint8_t* buffer;
+    size_t buffer_size;
+    uint32_t request_time;
+    uint8_t state;
+    uint8_t retry;
+} file_download_range_t;
+
 struct file_download_context {
     file_download_config_t config;
     file_download_event_t event;
     size_t file_size;
     size_t received_size;
+    size_t request_offset;
+    size_t range_length;
+    uint8_t range_acked;
+    uint32_t rtt;
+    uint32_t rate;
+    uint32_t rate_time;
+    size_t rate_bytes;
+    file_download_range_t range[FILE_DOWNLOAD_WINDOW_MAX];
+    uint8_t https;
+    uint8_t https_retry;
+    char https_host[128];
+    uint16_t https_port;
+    const char* https_path;
+    uint8_t* https_buffer;
+    MultiTimer https_timer;
     uint8_t retry;
     uint8_t state;
     uint8_t nextstate;
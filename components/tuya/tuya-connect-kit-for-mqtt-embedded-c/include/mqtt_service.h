@@ -10,6 +10,9 @@ extern "C" {
 #include "cJSON.h"
 #include "mqtt_client_interface.h"
 #include "backoff_algorithm.h"
+#include "aes_inf.h"
+#include "mpsc_ring.h"
+#include "json_writer.h"
 
 // data max len
 #define TUYA_MQTT_CLIENTID_MAXLEN (32U)
@@ -71,23 +74,6 @@ typedef struct {
     const char* localkey;
 } tuya_meta_info_t;
 
-typedef struct {
-    const uint8_t* cacert;
-    size_t         cacert_len;
-    const char*    host;
-    uint16_t       port;
-    uint32_t       timeout;
-    const char*    uuid;
-    const char*    authkey;
-    const char*    devid;
-    const char*    seckey;
-    const char*    localkey;
-    void*          user_data;
-    void           (*on_connected)(void* context, void* user_data);
-    void           (*on_disconnect)(void* context, void* user_data);
-    void           (*on_unbind)(void* context, void* user_data);
-} tuya_mqtt_config_t;
-
 typedef struct {
     char clientid[TUYA_MQTT_CLIENTID_MAXLEN];
     char username[TUYA_MQTT_USERNAME_MAXLEN];
@@ -102,19 +88,42 @@ typedef struct {
     cJSON*   root_json;
     cJSON*   data;
     void*    user_data;
+    char*    raw_data;   /* "data" value text for raw handlers, root_json and data are NULL then */
+    size_t   raw_length;
 } tuya_protocol_event_t;
 
 typedef tuya_protocol_event_t tuya_mqtt_event_t; // compat TODO:remove
 
 typedef void (*tuya_protocol_callback_t)(tuya_protocol_event_t* event);
 
-typedef struct tuya_protocol_handle {
-    struct tuya_protocol_handle* next;
+/* Handlers are kept sorted by id, several handlers of one id are adjacent */
+typedef struct {
     uint16_t id;
+    bool raw;
     tuya_protocol_callback_t cb;
     void* user_data;
 } tuya_protocol_handle_t;
 
+typedef struct {
+    const uint8_t* cacert;
+    size_t         cacert_len;
+    const char*    host;
+    uint16_t       port;
+    uint32_t       timeout;
+    const char*    uuid;
+    const char*    authkey;
+    const char*    devid;
+    const char*    seckey;
+    const char*    localkey;
+    void*          user_data;
+    /* Handlers fixed at build time, sorted by id, a NULL user_data gets user_data above */
+    const tuya_protocol_handle_t* protocols;
+    size_t         protocol_count;
+    void           (*on_connected)(void* context, void* user_data);
+    void           (*on_disconnect)(void* context, void* user_data);
+    void           (*on_unbind)(void* context, void* user_data);
+} tuya_mqtt_config_t;
+
 typedef void(*mqtt_subscribe_message_cb_t)(uint16_t msgid, const mqtt_client_message_t* msg, void* userdata);
 
 typedef struct mqtt_subscribe_handle {
@@ -134,6 +143,7 @@ typedef struct mqtt_publish_handle {
     char* topic;
     uint8_t* payload;
     size_t payload_length;
+    bool encrypt; /* payload is PV22 plaintext, encrypted and numbered by the loop task */
     mqtt_publish_notify_cb_t cb;
     void* user_data;
 } mqtt_publish_handle_t;
@@ -141,9 +151,15 @@ typedef struct mqtt_publish_handle {
 typedef struct {
     void* mqtt_client;
     tuya_mqtt_access_t signature;
+    AES128_KEY_CTX_S cipher;
+    const tuya_protocol_handle_t* protocol_table;
+    size_t protocol_table_count;
     tuya_protocol_handle_t* protocol_list;
+    size_t protocol_count;
+    size_t protocol_capacity;
     mqtt_subscribe_handle_t* subscribe_list;
     mqtt_publish_handle_t* publish_list;
+    mpsc_ring_t publish_queue;
     BackoffAlgorithmContext_t backoff_algorithm;
     uint32_t sequence_in;
     uint32_t sequence_out;
@@ -165,14 +181,25 @@ int tuya_mqtt_stop(tuya_mqtt_context_t* context);
 
 int tuya_mqtt_loop(tuya_mqtt_context_t* context);
 
+/* Sleep until the connection has data, the keepalive is due, a publish is queued or timeout_ms. */
+int tuya_mqtt_wait(tuya_mqtt_context_t* context, uint32_t timeout_ms);
+
 int tuya_mqtt_destory(tuya_mqtt_context_t* context);
 
 bool tuya_mqtt_connected(tuya_mqtt_context_t* context);
 
 int tuya_mqtt_protocol_register(tuya_mqtt_context_t* context, uint16_t protocol_id, tuya_protocol_callback_t cb, void* user_data);
 
+/* Like tuya_mqtt_protocol_register, but cb gets the message unparsed in raw_data and may modify it.
+ * Messages of a protocol with only raw handlers are never built into a cJSON tree. Raw handlers
+ * run after every tree handler of the message, whatever order they were registered in. */
+int tuya_mqtt_protocol_register_raw(tuya_mqtt_context_t* context, uint16_t protocol_id, tuya_protocol_callback_t cb, void* user_data);
+
+/* Handlers given in tuya_mqtt_config_t.protocols stay registered */
 int tuya_mqtt_protocol_unregister(tuya_mqtt_context_t* context, uint16_t protocol_id, tuya_protocol_callback_t cb);
 
+/* Publishes may be called from any task, they are queued and sent by the task running
+ * tuya_mqtt_loop, which also calls cb on PUBACK or timeout. Without cb they go out with QoS 0. */
 int tuya_mqtt_protocol_data_publish(tuya_mqtt_context_t* context, uint16_t protocol_id, const uint8_t* data, uint16_t length);
 
 int tuya_mqtt_protocol_data_publish_with_topic(tuya_mqtt_context_t* context, const char* topic, uint16_t protocol_id, const uint8_t* data, uint16_t length);
@@ -180,12 +207,24 @@ int tuya_mqtt_protocol_data_publish_with_topic(tuya_mqtt_context_t* context, con
 int tuya_mqtt_protocol_data_publish_common(tuya_mqtt_context_t* context,
 										   uint16_t protocol_id, const uint8_t* data, uint16_t length,
 										   mqtt_publish_notify_cb_t cb, void* user_data,
-										   int timeout_ms, bool async);
+										   int timeout_ms);
 
 int tuya_mqtt_protocol_data_publish_with_topic_common(tuya_mqtt_context_t* context, const char* topic, 
 										              uint16_t protocol_id, const uint8_t* data, uint16_t length,
 										              mqtt_publish_notify_cb_t cb, void* user_data,
-										              int timeout_ms, bool async);
+										              int timeout_ms);
+
+/* Writes the "data" member of a protocol message, called once on the publishing task.
+ * Anything but OPRT_OK drops the message. */
+typedef int (*tuya_mqtt_data_writer_t)(json_writer_t* writer, void* user_data);
+
+/* Like tuya_mqtt_protocol_data_publish_common, but writer puts data straight into the packet
+ * buffer, sized for at most length bytes of it. Data that does not fit fails with
+ * OPRT_EXCEED_UPPER_LIMIT. */
+int tuya_mqtt_protocol_data_write_common(tuya_mqtt_context_t* context, uint16_t protocol_id, size_t length,
+										 tuya_mqtt_data_writer_t writer, void* writer_data,
+										 mqtt_publish_notify_cb_t cb, void* user_data,
+										 int timeout_ms);
 
 int tuya_mqtt_subscribe_message_callback_register(tuya_mqtt_context_t* context, const char* topic, mqtt_subscribe_message_cb_t cb, void* userdata);
 
@@ -0,0 +1,59 @@
+#ifndef _OTA_DELTA_H_
+#define _OTA_DELTA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "tuya_config_defaults.h"
+
+/*
+ * Delta image, rebuilds the new firmware from the running one.
+ *
+ * Header, little endian:
+ *   "TYDP" | source size (u32) | source crc32 (u32) | image size (u32)
+ * Followed by blocks until image size bytes are produced:
+ *   add len (u32) | extra len (u32) | seek (i32)
+ *   add len bytes, each added to the next source byte
+ *   extra len bytes, copied as they are
+ * The source position moves by add len, then by seek.
+ */
+#define OTA_DELTA_MAGIC "TYDP"
+#define OTA_DELTA_HEADER_LEN 16
+#define OTA_DELTA_CONTROL_LEN 12
+
+typedef int (*ota_delta_output_cb_t)(const uint8_t* data, size_t len, void* user_data);
+
+typedef struct {
+    uint8_t state;
+    uint8_t fill;
+    uint8_t header[OTA_DELTA_HEADER_LEN];
+    uint32_t add_len;
+    uint32_t extra_len;
+    int32_t seek;
+    size_t source_size;
+    size_t source_offset;
+    size_t image_size;
+    size_t total;
+    uint8_t* buffer;
+    ota_delta_output_cb_t output_cb;
+    void* user_data;
+} ota_delta_t;
+
+int ota_delta_init(ota_delta_t* delta, ota_delta_output_cb_t output_cb, void* user_data);
+
+/**
+ * Apply the next part of the patch, split anywhere. The rebuilt image
+ * goes to output_cb in order, image_size is known from the first call
+ * that completes the header.
+ */
+int ota_delta_feed(ota_delta_t* delta, const uint8_t* data, size_t len);
+
+void ota_delta_free(ota_delta_t* delta);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
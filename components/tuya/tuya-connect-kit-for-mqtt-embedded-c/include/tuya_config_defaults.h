@@ -34,6 +34,39 @@
     #define MQTT_KEEPALIVE_INTERVALIN (120)
 #endif
 
+/**
+ * @brief Publishes that other tasks may have queued before the MQTT loop
+ * drains them, a power of two. Also the most one loop pass sends.
+ */
+#ifndef MQTT_PUBLISH_QUEUE_LENGTH
+    #define MQTT_PUBLISH_QUEUE_LENGTH (16U)
+#endif
+
+/**
+ * @brief DP reports other tasks may have queued for merging before the
+ * loop picks them up, a power of two. Only used with dp_report_window_ms.
+ */
+#ifndef DP_REPORT_QUEUE_LENGTH
+    #define DP_REPORT_QUEUE_LENGTH (16U)
+#endif
+
+/**
+ * @brief Largest compiled DP schema table kept in flash, 16 bytes per DP
+ * plus the enum names. Without a table that fits, DPs go unchecked.
+ */
+#ifndef DP_SCHEMA_TABLE_LENGTH
+    #define DP_SCHEMA_TABLE_LENGTH (2048U)
+#endif
+
+/**
+ * @brief Arena the cJSON tree of one inbound MQTT message is built in,
+ * released in one go after dispatch. Larger messages spill to the heap,
+ * 0 keeps every cJSON allocation on the heap.
+ */
+#ifndef CJSON_ARENA_SIZE
+    #define CJSON_ARENA_SIZE (4096U)
+#endif
+
 /**
  * @brief Defaults auto check upgrade interval.
  * 
@@ -84,4 +117,46 @@
     #define MATOP_TIMEOUT_MS_DEFAULT (8000U)
 #endif
 
+/**
+ * @brief Max number of range requests kept in flight by a file download.
+ */
+#ifndef FILE_DOWNLOAD_WINDOW_MAX
+    #define FILE_DOWNLOAD_WINDOW_MAX (8U)
+#endif
+
+/**
+ * @brief Range size bounds of a file download. A range response is received
+ * whole into the MQTT buffer (CORE_MQTT_BUFFER_SIZE) together with its
+ * topic and headers, so the upper bound has to follow that buffer.
+ */
+#ifndef FILE_DOWNLOAD_RANGE_MAX
+    #define FILE_DOWNLOAD_RANGE_MAX (2048U - 128U)
+#endif
+
+#ifndef FILE_DOWNLOAD_RANGE_MIN
+    #define FILE_DOWNLOAD_RANGE_MIN (256U)
+#endif
+
+/**
+ * @brief Range size of a file download over HTTPS, one range is fetched
+ * per loop into a buffer of this size plus the response headers.
+ */
+#ifndef FILE_DOWNLOAD_HTTPS_RANGE_LENGTH
+    #define FILE_DOWNLOAD_HTTPS_RANGE_LENGTH (4096U)
+#endif
+
+/**
+ * @brief Consecutive HTTPS range failures before falling back to MQTT.
+ */
+#ifndef FILE_DOWNLOAD_HTTPS_RETRY_MAX
+    #define FILE_DOWNLOAD_HTTPS_RETRY_MAX (3U)
+#endif
+
+/**
+ * @brief Bytes of the running image read at a time while applying a delta OTA.
+ */
+#ifndef OTA_DELTA_BUFFER_SIZE
+    #define OTA_DELTA_BUFFER_SIZE (256U)
+#endif
+
 #endif /* ifndef TUYA_CONFIG_DEFAULTS_H_ */
@@ -0,0 +1,65 @@
+#ifndef _TUYA_DP_H_
+#define _TUYA_DP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define TUYA_DP_ID_MAX (255)
+
+/* Tuya DP types */
+typedef enum {
+    TUYA_DP_TYPE_RAW,
+    TUYA_DP_TYPE_BOOL,
+    TUYA_DP_TYPE_VALUE,
+    TUYA_DP_TYPE_STRING,
+    TUYA_DP_TYPE_ENUM,
+    TUYA_DP_TYPE_BITMAP,
+} tuya_dp_type_t;
+
+/**
+ * One DP of a command. Strings point into the message, unescaped and NUL
+ * terminated in place, valid until the callback returns. JSON alone does
+ * not tell enum and raw from string, or bitmap from value, it takes the
+ * product schema (tuya_dp_schema_decode) to type those.
+ */
+typedef struct {
+    uint8_t id;
+    tuya_dp_type_t type;
+    union {
+        bool asBool;
+        int32_t asValue;
+        uint32_t asEnum;
+        uint32_t asBitmap;
+        struct {
+            const char* str;
+            size_t len;
+        } asString;
+        struct {
+            const uint8_t* data;
+            size_t len;
+        } asRaw;
+    } value;
+} tuya_dp_t;
+
+typedef void (*tuya_dp_cb_t)(const tuya_dp_t* dp, void* user_data);
+
+/**
+ * Walk a dps object, e.g. {"101":true,"102":"abc"}, once and hand each DP
+ * to cb as it is reached, without allocating. The buffer is modified in
+ * place. DPs with a non numeric id, or a null, fractional, object or
+ * array value, are skipped.
+ *
+ * @return OPRT_OK, or OPRT_CJSON_PARSE_ERR at the first malformed token,
+ * DPs before it have already been handed out.
+ */
+int tuya_dp_parse(char* dps, size_t len, tuya_dp_cb_t cb, void* user_data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
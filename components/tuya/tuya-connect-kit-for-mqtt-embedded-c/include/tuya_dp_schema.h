@@ -0,0 +1,152 @@
+#ifndef _TUYA_DP_SCHEMA_H_
+#define _TUYA_DP_SCHEMA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "tuya_dp.h"
+#include "json_writer.h"
+
+/* Bump when the compiled table layout changes, older tables are recompiled */
+#define TUYA_DP_SCHEMA_VERSION (1)
+
+/* Who may write a DP */
+typedef enum {
+    TUYA_DP_MODE_RW,
+    TUYA_DP_MODE_RO, /* reported by the device only */
+    TUYA_DP_MODE_WR, /* commanded by the cloud only */
+} tuya_dp_mode_t;
+
+/**
+ * One DP of the compiled schema, as stored in flash.
+ *
+ * value:  min and max bound the integer, scale is its decimal places
+ * enum:   max is the highest index, labels the offset of its NUL
+ *         separated names in the label pool
+ * bitmap: max is the number of bits
+ * string, raw: max is the maximum length in bytes, 0 for no limit
+ */
+typedef struct {
+    uint8_t id;
+    uint8_t type;
+    uint8_t mode;
+    uint8_t scale;
+    int32_t min;
+    int32_t max;
+    uint16_t labels;
+    uint16_t reserved;
+} tuya_dp_schema_entry_t;
+
+/* A set of DP ids, one bit each */
+typedef struct {
+    uint32_t bits[(TUYA_DP_ID_MAX + 1) / 32];
+} tuya_dp_marks_t;
+
+/**
+ * A loaded schema and the last value set for each of its bool, value,
+ * enum and bitmap DPs. index maps a DP id straight to its entry.
+ */
+typedef struct {
+    uint8_t index[TUYA_DP_ID_MAX + 1]; /* entry + 1, 0 for an unknown id */
+    uint8_t count;
+    const tuya_dp_schema_entry_t* entries;
+    const char* labels;
+    int32_t* values;
+    uint32_t valid[(TUYA_DP_ID_MAX + 1) / 32];
+    uint32_t dirty[(TUYA_DP_ID_MAX + 1) / 32];
+    void* buffer;
+} tuya_dp_schema_t;
+
+/**
+ * Compile the schema JSON of the activation response into a flat table
+ * fit for storage. DPs the table cannot describe are left out.
+ *
+ * @param json - schema array e.g: [{"id":101,"mode":"rw","type":"obj","property":{"type":"bool"}}]
+ * @param table - output buffer.
+ * @param length - in: size of table, out: bytes written.
+ * @return int - OPRT_OK, OPRT_CJSON_PARSE_ERR or OPRT_EXCEED_UPPER_LIMIT.
+ */
+int tuya_dp_schema_compile(const char* json, uint8_t* table, size_t* length);
+
+/**
+ * Check a compiled table and load a copy of it, with no values set.
+ * A schema already loaded is freed first.
+ */
+int tuya_dp_schema_load(tuya_dp_schema_t* schema, const uint8_t* table, size_t length);
+
+void tuya_dp_schema_free(tuya_dp_schema_t* schema);
+
+static inline bool tuya_dp_schema_loaded(const tuya_dp_schema_t* schema)
+{
+    return schema->buffer != NULL;
+}
+
+static inline const tuya_dp_schema_entry_t* tuya_dp_schema_find(const tuya_dp_schema_t* schema, uint8_t id)
+{
+    return schema->index[id] ? &schema->entries[schema->index[id] - 1] : NULL;
+}
+
+/**
+ * Check a DP received from the cloud against the schema and give it its
+ * schema type: enum names become indexes and raw DPs are base64 decoded
+ * in place.
+ *
+ * @return int - OPRT_OK, OPRT_NOT_FOUND for a DP outside the schema,
+ * OPRT_NOT_SUPPORTED for a read only DP, or OPRT_INVALID_PARM.
+ */
+int tuya_dp_schema_decode(const tuya_dp_schema_t* schema, tuya_dp_t* dp);
+
+/**
+ * Set the value of a bool, value, enum or bitmap DP. dp->type has to
+ * match the schema and the value be in range. The DP is marked for the
+ * next report, also while another task takes the marks.
+ */
+int tuya_dp_schema_set(tuya_dp_schema_t* schema, const tuya_dp_t* dp);
+
+/* Last value set, OPRT_NOT_FOUND if the DP has none */
+int tuya_dp_schema_get(const tuya_dp_schema_t* schema, uint8_t id, tuya_dp_t* dp);
+
+static inline bool tuya_dp_schema_dirty(const tuya_dp_schema_t* schema, uint8_t id)
+{
+    return (__atomic_load_n(&schema->dirty[id / 32], __ATOMIC_RELAXED) >> (id % 32)) & 1;
+}
+
+/**
+ * Move the report marks into marks. DPs set from here on are marked again
+ * and go out with the next report, whatever happens to this one.
+ */
+void tuya_dp_schema_dirty_take(tuya_dp_schema_t* schema, tuya_dp_marks_t* marks);
+
+/* Mark the taken DPs again, for a report that was not sent */
+void tuya_dp_schema_dirty_restore(tuya_dp_schema_t* schema, const tuya_dp_marks_t* marks);
+
+/* Bytes tuya_dp_schema_serialize may write */
+size_t tuya_dp_schema_serialize_bound(const tuya_dp_schema_t* schema, const tuya_dp_marks_t* marks);
+
+/**
+ * Write the DPs in marks as a dps object, e.g. {"101":true,"102":"low"}.
+ *
+ * @return int - OPRT_OK, or OPRT_EXCEED_UPPER_LIMIT once the writer overflowed.
+ */
+int tuya_dp_schema_serialize(const tuya_dp_schema_t* schema, const tuya_dp_marks_t* marks, json_writer_t* writer);
+
+/* Bytes tuya_dp_schema_values_serialize may write */
+size_t tuya_dp_schema_values_bound(const tuya_dp_schema_t* schema, const tuya_dp_t* dps, size_t count);
+
+/**
+ * Write count DPs as a dps object: strings escaped, raw DPs base64 encoded
+ * and enums by name. With a schema loaded every DP has to be in it with the
+ * same type, without one enum DPs can not be written.
+ *
+ * @return int - OPRT_OK, OPRT_INVALID_PARM or OPRT_EXCEED_UPPER_LIMIT.
+ */
+int tuya_dp_schema_values_serialize(const tuya_dp_schema_t* schema, json_writer_t* writer, const tuya_dp_t* dps, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -18,6 +18,9 @@ extern "C" {
 #include "matop_service.h"
 #include "cJSON.h"
 #include "MultiTimer.h"
+#include "mpsc_ring.h"
+#include "tuya_dp.h"
+#include "tuya_dp_schema.h"
 
 /**
  * @brief SDK Version info
@@ -56,6 +59,7 @@ typedef enum {
     TUYA_EVENT_TIMESTAMP_SYNC,
     TUYA_EVENT_DPCACHE_NOTIFY,
     TUYA_EVENT_BINDED_NOTIFY,
+    TUYA_EVENT_DP_RECEIVE_VALUE,
 } tuya_event_id_t;
 
 #define EVENT_ID2STR(S)\
@@ -72,7 +76,8 @@ typedef enum {
 ((S) == TUYA_EVENT_TIMESTAMP_SYNC ? "TUYA_EVENT_TIMESTAMP_SYNC":\
 ((S) == TUYA_EVENT_DPCACHE_NOTIFY ? "TUYA_EVENT_DPCACHE_NOTIFY":\
 ((S) == TUYA_EVENT_BINDED_NOTIFY ? "TUYA_EVENT_BINDED_NOTIFY":\
-"Unknown")))))))))))))
+((S) == TUYA_EVENT_DP_RECEIVE_VALUE ? "TUYA_EVENT_DP_RECEIVE_VALUE":\
+"Unknown"))))))))))))))
 
 typedef enum {
     TUYA_STATUS_UNACTIVE = 0,
@@ -96,7 +101,8 @@ typedef enum {
     TUYA_DATE_TYPE_INTEGER,
     TUYA_DATE_TYPE_STRING,
     TUYA_DATE_TYPE_RAW,
-    TUYA_DATE_TYPE_JSON
+    TUYA_DATE_TYPE_JSON,
+    TUYA_DATE_TYPE_DP
 } tuya_data_type_t;
 
 typedef void(*tuya_dp_notify_cb_t)(int result, void* user_data);
@@ -106,6 +112,7 @@ typedef union {
     bool        asBoolean;
     int32_t     asInteger;
     cJSON *     asJSON;
+    const tuya_dp_t * asDP;
     struct {
         uint8_t * buffer;
         uint32_t  length;
@@ -132,6 +139,12 @@ typedef struct {
     const char* storage_namespace;
     const char* firmware_key;
     event_handle_cb_t event_handler;
+    /* DP reports issued within this window are merged into one publish, 0 sends each at once */
+    uint32_t dp_report_window_ms;
+    /* DP commands arrive as one TUYA_EVENT_DP_RECEIVE_VALUE per DP, parsed in a single pass
+     * without allocating, instead of the DP_RECEIVE and DP_RECEIVE_CJSON events. Once the
+     * product schema is known, DPs outside it or out of range are dropped */
+    bool dp_receive_typed;
 } tuya_iot_config_t;
 
 typedef struct {
@@ -161,6 +174,11 @@ struct tuya_iot_client_handle {
     tuya_activate_token_get_t token_get;
     tuya_binding_info_t* binding;
     MultiTimer check_upgrade_timer;
+    MultiTimer dp_report_timer;
+    mpsc_ring_t dp_report_queue;
+    cJSON* dp_report_pending;
+    struct tuya_dp_report* dp_report_waiters;
+    tuya_dp_schema_t dp_schema;
     uint8_t state;
     uint8_t nextstate;
     bool is_activated;
@@ -226,6 +244,10 @@ int tuya_iot_yield(tuya_iot_client_t* client);
 /**
  * @brief Report Tuya data point(DP) services to the cloud.
  *
+ * With config.dp_report_window_ms set, reports without a time are merged
+ * with the others issued in the same window, the last value of a DP wins.
+ * Every caller's cb still runs once with the result of the merged publish.
+ *
  * @param client - The Tuya client context.
  * @param dps - DP JSON format e.g: "{"101":true}"
  * @return int - OPRT_OK successful or error code.
@@ -268,6 +290,60 @@ int tuya_iot_dp_report_json_async(tuya_iot_client_t* client, const char* dps, co
  */
 int tuya_iot_dp_report_json_with_notify(tuya_iot_client_t* client, const char* dps, const char* time, tuya_dp_notify_cb_t cb, void* user_data, int timeout_ms);
 
+/**
+ * @brief Set a DP of the product schema, checked against its type and range.
+ *
+ * Values are kept by the client and every DP set goes out with the next
+ * tuya_iot_dp_report. Sets and reports may come from different tasks, a DP
+ * set while a report is written goes out with the next one.
+ *
+ * @param client - The Tuya client context.
+ * @param id - DP id.
+ * @param value - New value, the enum index for enum DPs.
+ * @return int - OPRT_OK, OPRT_NOT_FOUND for a DP outside the schema,
+ * OPRT_INVALID_PARM for a wrong type or value, or OPRT_RESOURCE_NOT_READY
+ * before the schema is known.
+ */
+int tuya_iot_dp_set_bool(tuya_iot_client_t* client, uint8_t id, bool value);
+
+int tuya_iot_dp_set_int(tuya_iot_client_t* client, uint8_t id, int32_t value);
+
+int tuya_iot_dp_set_enum(tuya_iot_client_t* client, uint8_t id, uint32_t value);
+
+int tuya_iot_dp_set_bitmap(tuya_iot_client_t* client, uint8_t id, uint32_t value);
+
+/**
+ * @brief Get the last value set of a DP.
+ *
+ * @param client - The Tuya client context.
+ * @param id - DP id.
+ * @return The value, the index of enum DPs, false or 0 if none was set.
+ */
+bool tuya_iot_dp_get_bool(tuya_iot_client_t* client, uint8_t id);
+
+int32_t tuya_iot_dp_get_int(tuya_iot_client_t* client, uint8_t id);
+
+/**
+ * @brief Report the DPs set by tuya_iot_dp_set_* since the last report.
+ *
+ * @param client - The Tuya client context.
+ * @return int - OPRT_OK successful, nothing to report included, or error code.
+ */
+int tuya_iot_dp_report(tuya_iot_client_t* client);
+
+/**
+ * @brief Report typed DP values, written straight into the MQTT packet.
+ *
+ * Any DP type can be reported: strings are escaped, raw DPs base64
+ * encoded and enums sent by name, which takes the product schema.
+ *
+ * @param client - The Tuya client context.
+ * @param dps - DP values.
+ * @param count - Number of DP values.
+ * @return int - OPRT_OK successful or error code.
+ */
+int tuya_iot_dp_report_values(tuya_iot_client_t* client, const tuya_dp_t* dps, size_t count);
+
 /**
  * @brief Is Tuya client has been activated?
  *
@@ -9,6 +9,10 @@ extern "C" {
 #include <stddef.h>
 #include "file_download.h"
 #include "tuya_iot.h"
+#include "uni_md5.h"
+#include "mbedtls/sha256.h"
+#include "lzss_decoder.h"
+#include "ota_delta.h"
 
 #define TUS_RD 1
 #define TUS_UPGRDING 2
@@ -44,9 +48,40 @@ typedef struct {
     size_t data_len;
     size_t offset;
     size_t file_size;
+    size_t range_size;
+    uint32_t rate;
     void* user_data;
 } tuya_ota_event_t;
 
+/* Resume point of an interrupted download, saved once the sink has synced it */
+typedef struct {
+    uint32_t identity; /* of the image and of the layout of the hash contexts below */
+    uint32_t offset;
+    UNI_MD5_CTX_S md5_ctx;
+#if !defined(MBEDTLS_SHA256_ALT)
+    mbedtls_sha256_context sha256_ctx;
+#endif
+} tuya_ota_checkpoint_t;
+
+/*
+ * Delta image, announced by "delta":true in the upgrade message, see
+ * ota_delta.h for the patch format. It may be compressed as well.
+ *
+ * Compressed image, announced by "compress":"lzss" in the upgrade message.
+ * The download starts with this header, followed by the heatshrink stream
+ * of the firmware. md5/sha256 cover the downloaded (compressed) file.
+ */
+#define TUYA_OTA_LZSS_MAGIC "TYLZ"
+#define TUYA_OTA_LZSS_HEADER_LEN 12
+
+typedef struct {
+    char magic[4];
+    uint8_t window_sz2;
+    uint8_t lookahead_sz2;
+    uint8_t reserved[2];
+    uint8_t image_size[4]; /* little endian, size once decompressed */
+} tuya_ota_lzss_header_t;
+
 typedef struct tuya_ota_handle tuya_ota_handle_t;
 
 typedef void (*tuya_ota_event_cb_t)(tuya_ota_handle_t* handle, tuya_ota_event_t* event);
@@ -55,7 +90,9 @@ typedef struct {
     tuya_iot_client_t* client;
     tuya_ota_event_cb_t event_cb;
     size_t range_size;
+    uint8_t window_size;
     uint32_t timeout_ms;
+    bool sink_enable;
     void* user_data;
 } tuya_ota_config_t;
 
@@ -66,10 +103,26 @@ struct tuya_ota_handle {
     tuya_ota_event_t event;
     uint8_t channel;
     uint8_t progress_percent;
+    bool running; /* from tuya_ota_begin until the download finished or failed */
+    void* sink;
+    char md5[33];
+    char sha256[65];
+    UNI_MD5_CTX_S md5_ctx;
+    mbedtls_sha256_context sha256_ctx;
+    tuya_ota_checkpoint_t checkpoint;
+    uint32_t checkpoint_identity;
+    bool compressed;
+    uint8_t header_len;
+    tuya_ota_lzss_header_t header;
+    size_t image_size;
+    lzss_decoder_t decoder;
+    bool delta;
+    ota_delta_t patch;
 };
 
 int tuya_ota_init(tuya_ota_handle_t* handle, const tuya_ota_config_t* config);
 
+/* Start the upgrade described by the notification, OPRT_COM_ERROR while one is still running */
 int tuya_ota_begin(tuya_ota_handle_t* handle, cJSON* upgrade);
 
 int tuya_ota_upgrade_status_report(tuya_ota_handle_t* handle, int status);
@@ -0,0 +1,19 @@
+#ifndef __CRYPTO_INTERFACE_H_
+#define __CRYPTO_INTERFACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Register the platform AES-128 ECB/CBC implementation with aes_inf.
+ * Platforms without an accelerator return OPRT_OK without registering,
+ * the SDK then keeps using its software AES.
+ */
+int crypto_aes_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__CRYPTO_INTERFACE_H_
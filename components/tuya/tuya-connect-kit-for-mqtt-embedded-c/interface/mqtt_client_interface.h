@@ -34,6 +34,8 @@ typedef enum mqtt_cleint_qos
 
 typedef struct mqtt_client_message {
     const char* topic;
+    /* Points into the client receive buffer, only valid while on_message runs.
+     * The buffer is owned by the client, so handlers may decode it in place. */
     const uint8_t* payload;
     size_t length;
     mqtt_client_qos_t qos;
@@ -70,8 +72,12 @@ mqtt_client_status_t mqtt_client_connect(void* client);
 
 mqtt_client_status_t mqtt_client_disconnect(void* client);
 
+/* Handle one incoming packet if there is one and the keepalive, never waits for data. */
 mqtt_client_status_t mqtt_client_yield(void* client);
 
+/* Block until data arrives, the keepalive is due, network_wakeup() or timeout_ms. */
+mqtt_client_status_t mqtt_client_wait(void* client, uint32_t timeout_ms);
+
 uint16_t mqtt_client_subscribe(void* client, const char* topic, uint8_t qos);
 
 uint16_t mqtt_client_unsubscribe(void* client, const char* topic, uint8_t qos);
@@ -131,6 +131,19 @@ int network_tls_write(NetworkContext_t *pNetwork, const unsigned char *pMsg, siz
  */
 int network_tls_read(NetworkContext_t *pNetwork, unsigned char *pMsg, size_t len);
 
+/**
+ * Block until pNetwork has data to read, network_wakeup() is called or
+ * timeout_ms passes. pNetwork may be NULL, or not connected, to wait for
+ * the wakeup alone. A zero timeout polls the connection and leaves a
+ * pending wakeup in place. Returns 1 when there is data to read, 0 otherwise.
+ */
+int network_tls_wait(NetworkContext_t *pNetwork, uint32_t timeout_ms);
+
+/**
+ * End the current or next network_tls_wait early, callable from any task.
+ */
+void network_wakeup(void);
+
 
 #ifdef __cplusplus
 }
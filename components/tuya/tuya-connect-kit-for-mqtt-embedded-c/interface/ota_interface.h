@@ -0,0 +1,50 @@
+#ifndef __OTA_INTERFACE_H_
+#define __OTA_INTERFACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Open the platform image sink for a firmware of image_size bytes.
+ * The sink receives the image strictly in order, it owns any buffering
+ * needed to keep slow flash writes off the caller's loop.
+ * A nonzero offset resumes an image whose first offset bytes were synced
+ * by an earlier sink, it is always a multiple of 4 KB.
+ */
+int ota_sink_begin(size_t image_size, size_t offset, void** handle);
+
+int ota_sink_write(void* handle, const uint8_t* data, size_t len);
+
+/**
+ * Block until the data written so far is in storage, up to the last
+ * 4 KB boundary at least.
+ */
+int ota_sink_sync(void* handle);
+
+/**
+ * Flush, validate and mark the written image bootable. The handle is
+ * released whatever the result.
+ */
+int ota_sink_finish(void* handle);
+
+/**
+ * Stop writing without switching images. Data already synced stays in
+ * place so a later ota_sink_begin can resume it.
+ */
+int ota_sink_abort(void* handle);
+
+/**
+ * Read len bytes at offset of the firmware currently running, the base
+ * image delta updates are applied against.
+ */
+int ota_source_read(size_t offset, uint8_t* buffer, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__OTA_INTERFACE_H_
@@ -22,6 +22,9 @@ void system_sleep(uint32_t time_ms);
 
 uint32_t system_random(void);
 
+/* Identifies the calling task, only compared for equality */
+void* system_thread_self(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,5 +38,32 @@
  */
 #define HTTP_USER_AGENT_VALUE    "TUYA_IOT_SDK"
 
+/**
+ * @brief Number of idle keep-alive TLS connections kept by http_client_request.
+ *
+ * Connections are keyed by host, port and CA certificate, so back-to-back
+ * requests to the same server reuse one TLS session instead of handshaking
+ * again.
+ *
+ * <b>Possible values:</b> Any positive integer. <br>
+ * <b>Default value:</b> `2`
+ */
+#ifndef HTTP_CLIENT_KEEPALIVE_POOL_SIZE
+#define HTTP_CLIENT_KEEPALIVE_POOL_SIZE    2U
+#endif
+
+/**
+ * @brief Time in milliseconds an idle pooled connection is kept open.
+ *
+ * The idle connection is closed from the MultiTimer background processing
+ * once this expires. Set to 0 to close the connection after every request.
+ *
+ * <b>Possible values:</b> Any 32 bit integer. <br>
+ * <b>Default value:</b> `30000`
+ */
+#ifndef HTTP_CLIENT_KEEPALIVE_IDLE_MS
+#define HTTP_CLIENT_KEEPALIVE_IDLE_MS    30000U
+#endif
+
 
 #endif /* ifndef CORE_HTTP_CONFIG_DEFAULTS_ */
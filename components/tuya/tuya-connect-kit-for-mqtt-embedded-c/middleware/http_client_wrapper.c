@@ -5,10 +5,192 @@
 #include "http_client_interface.h"
 #include "transport_interface.h"
 #include "system_interface.h"
+#include "MultiTimer.h"
+#include "core_http_config.h"
 #include "core_http_client.h"
 
 #define HEADER_BUFFER_LENGTH (255)
 
+/* Idle keep-alive TLS connection, keyed by host:port and CA certificate */
+typedef struct {
+    bool in_use;
+    char *host;
+    uint16_t port;
+    const uint8_t *cacert;
+    NetworkContext_t network;
+    MultiTimer idle_timer;
+} http_client_connection_t;
+
+static http_client_connection_t s_connection_pool[HTTP_CLIENT_KEEPALIVE_POOL_SIZE];
+
+/* Transport of one request, it counts what went over the wire to tell if a retry is safe */
+typedef struct {
+    NetworkContext_t *network;
+    size_t sent;
+    size_t received;
+    bool recv_error;
+} http_client_transport_t;
+
+static int32_t http_client_transport_send(NetworkContext_t *context, const void *buffer, size_t len)
+{
+    http_client_transport_t *transport = (http_client_transport_t *)context;
+    int rv = network_tls_write(transport->network, (const unsigned char *)buffer, len);
+    if (rv > 0)
+    {
+        transport->sent += rv;
+    }
+    return rv;
+}
+
+static int32_t http_client_transport_recv(NetworkContext_t *context, void *buffer, size_t len)
+{
+    http_client_transport_t *transport = (http_client_transport_t *)context;
+    int rv = network_tls_read(transport->network, (unsigned char *)buffer, len);
+    if (rv > 0)
+    {
+        transport->received += rv;
+    }
+    else if (rv < 0)
+    {
+        transport->recv_error = true;
+    }
+    return rv;
+}
+
+/* Whether a request that failed on a reused connection may be sent again */
+static bool http_client_request_replayable(const http_client_request_t *request, const http_client_transport_t *transport)
+{
+    /* Nothing was sent, or the server closed the stale connection without answering */
+    if (transport->sent == 0 || (transport->recv_error && transport->received == 0))
+    {
+        return true;
+    }
+
+    /* Otherwise the server may have acted on it, e.g. a receive timeout on an activation POST */
+    return strcmp(request->method, "GET") == 0 || strcmp(request->method, "HEAD") == 0 ||
+           strcmp(request->method, "PUT") == 0 || strcmp(request->method, "DELETE") == 0 ||
+           strcmp(request->method, "OPTIONS") == 0;
+}
+
+static int http_client_connect(const http_client_request_t *request, NetworkContext_t *network)
+{
+    int rt = OPRT_OK;
+
+    rt = network_tls_init(network, &(const TLSConnectParams){
+                                       .cacert = request->cacert,
+                                       .cacert_len = request->cacert_len,
+                                       .client_cert = NULL,
+                                       .client_cert_len = 0,
+                                       .client_key = NULL,
+                                       .client_key_len = 0,
+                                       .host = request->host,
+                                       .port = request->port,
+                                       .timeout_ms = request->timeout_ms,
+                                       .cert_verify = true});
+
+    if (OPRT_OK != rt)
+    {
+        log_error("network_tls_init fail:%d", rt);
+        return rt;
+    }
+
+    /* Start TLS connect */
+    rt = network_tls_connect(network, NULL);
+    if (OPRT_OK != rt)
+    {
+        log_error("network_tls_connect fail:%d", rt);
+        network_tls_disconnect(network);
+        network_tls_destroy(network);
+        return rt;
+    }
+    log_debug("tls connencted!");
+
+    return OPRT_OK;
+}
+
+static void http_client_close(NetworkContext_t *network)
+{
+    network_tls_disconnect(network);
+    network_tls_destroy(network);
+}
+
+static void http_client_connection_release(http_client_connection_t *conn)
+{
+    MultiTimerStop(&conn->idle_timer);
+    http_client_close(&conn->network);
+    system_free(conn->host);
+    memset(conn, 0, sizeof(http_client_connection_t));
+}
+
+static void http_client_connection_idle_timeout(MultiTimer *timer, void *user_data)
+{
+    (void)timer;
+    http_client_connection_t *conn = (http_client_connection_t *)user_data;
+    log_debug("http keep-alive connection %s:%d idle, close", conn->host, conn->port);
+    http_client_connection_release(conn);
+}
+
+/* Take an idle connection to the request's server out of the pool */
+static bool http_client_connection_take(const http_client_request_t *request, NetworkContext_t *network)
+{
+    size_t i;
+    for (i = 0; i < HTTP_CLIENT_KEEPALIVE_POOL_SIZE; i++)
+    {
+        http_client_connection_t *conn = &s_connection_pool[i];
+        if (conn->in_use &&
+            conn->port == request->port &&
+            conn->cacert == request->cacert &&
+            strcmp(conn->host, request->host) == 0)
+        {
+            MultiTimerStop(&conn->idle_timer);
+            *network = conn->network;
+            system_free(conn->host);
+            memset(conn, 0, sizeof(http_client_connection_t));
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Keep a connection for the next request, the oldest one is evicted if full */
+static void http_client_connection_put(const http_client_request_t *request, NetworkContext_t *network)
+{
+    http_client_connection_t *conn = NULL;
+    size_t i;
+
+    for (i = 0; i < HTTP_CLIENT_KEEPALIVE_POOL_SIZE; i++)
+    {
+        if (!s_connection_pool[i].in_use)
+        {
+            conn = &s_connection_pool[i];
+            break;
+        }
+        if (NULL == conn || (int32_t)(s_connection_pool[i].idle_timer.deadline - conn->idle_timer.deadline) < 0)
+        {
+            conn = &s_connection_pool[i];
+        }
+    }
+    if (conn->in_use)
+    {
+        http_client_connection_release(conn);
+    }
+
+    conn->host = system_malloc(strlen(request->host) + 1);
+    if (NULL == conn->host)
+    {
+        http_client_close(network);
+        return;
+    }
+    strcpy(conn->host, request->host);
+    conn->port = request->port;
+    conn->cacert = request->cacert;
+    conn->network = *network;
+    conn->in_use = true;
+
+    MultiTimerInit(&conn->idle_timer, 0, http_client_connection_idle_timeout, conn);
+    MultiTimerStart(&conn->idle_timer, HTTP_CLIENT_KEEPALIVE_IDLE_MS);
+}
+
 static http_client_status_t core_http_request_send(
     const TransportInterface_t *pTransportInterface,
     const HTTPRequestInfo_t *requestInfo,
@@ -106,44 +288,32 @@ http_client_status_t http_client_request(const http_client_request_t *request,
                                          http_client_response_t *response)
 {
     http_client_status_t rt = HTTP_CLIENT_SUCCESS;
+    bool keepalive = HTTP_CLIENT_KEEPALIVE_IDLE_MS > 0;
+    bool reused = false;
 
-    /* TLS pre init */
+    /* Reuse an idle TLS connection to the same server, or handshake a new one */
     NetworkContext_t network;
 
-    rt = network_tls_init(&network, &(const TLSConnectParams){
-                                        .cacert = request->cacert,
-                                        .cacert_len = request->cacert_len,
-                                        .client_cert = NULL,
-                                        .client_cert_len = 0,
-                                        .client_key = NULL,
-                                        .client_key_len = 0,
-                                        .host = request->host,
-                                        .port = request->port,
-                                        .timeout_ms = request->timeout_ms,
-                                        .cert_verify = true});
-
-    if (OPRT_OK != rt)
+    if (keepalive && http_client_connection_take(request, &network))
     {
-        log_error("network_tls_init fail:%d", rt);
-        return rt;
+        log_debug("http keep-alive connection reused");
+        reused = true;
     }
-
-    /* Start TLS connect */
-    rt = network_tls_connect(&network, NULL);
-    if (OPRT_OK != rt)
+    else
     {
-        log_error("network_tls_connect fail:%d", rt);
-        network_tls_disconnect(&network);
-        network_tls_destroy(&network);
-        return rt;
+        rt = http_client_connect(request, &network);
+        if (OPRT_OK != rt)
+        {
+            return rt;
+        }
     }
-    log_debug("tls connencted!");
 
     /* http client TransportInterface */
+    http_client_transport_t transport = {.network = &network};
     TransportInterface_t pTransportInterface = {
-        .pNetworkContext = (NetworkContext_t *)&network,
-        .recv = (TransportRecv_t)network_tls_read,
-        .send = (TransportSend_t)network_tls_write};
+        .pNetworkContext = (NetworkContext_t *)&transport,
+        .recv = (TransportRecv_t)http_client_transport_recv,
+        .send = (TransportSend_t)http_client_transport_send};
 
     /* http client request object make */
     HTTPRequestInfo_t requestInfo = {
@@ -153,6 +323,7 @@ http_client_status_t http_client_request(const http_client_request_t *request,
         .hostLen = strlen(request->host),
         .pPath = request->path,
         .pathLen = strlen(request->path),
+        .reqFlags = keepalive ? HTTP_REQUEST_KEEP_ALIVE_FLAG : 0,
     };
 
     HTTPResponse_t http_response = {
@@ -168,9 +339,38 @@ http_client_status_t http_client_request(const http_client_request_t *request,
                                 (const uint8_t *)request->body,
                                 request->body_length,
                                 &http_response);
-    /* tls disconnect */
-    network_tls_disconnect(&network);
-    network_tls_destroy(&network);
+
+    /* The server may have closed the idle connection, retry once on a new one */
+    if (HTTP_CLIENT_SEND_FAULT == rt && reused && http_client_request_replayable(request, &transport))
+    {
+        log_warn("http keep-alive connection lost, reconnect");
+        http_client_close(&network);
+        rt = http_client_connect(request, &network);
+        if (OPRT_OK != rt)
+        {
+            return rt;
+        }
+        transport = (http_client_transport_t){.network = &network};
+        http_response.respFlags = 0;
+        rt = core_http_request_send((const TransportInterface_t *)&pTransportInterface,
+                                    (const HTTPRequestInfo_t *)&requestInfo,
+                                    request->headers,
+                                    request->headers_count,
+                                    (const uint8_t *)request->body,
+                                    request->body_length,
+                                    &http_response);
+    }
+
+    /* Keep the connection if the server agreed, otherwise tls disconnect */
+    if (OPRT_OK == rt && keepalive &&
+        !(http_response.respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG))
+    {
+        http_client_connection_put(request, &network);
+    }
+    else
+    {
+        http_client_close(&network);
+    }
 
     if (OPRT_OK != rt)
     {
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include <string.h>
 #include "log.h"
 #include "tuya_error_code.h"
@@ -12,8 +13,32 @@ typedef struct {
     MQTTContext_t mqclient;
     NetworkContext_t network;
     uint8_t mqttbuffer[CORE_MQTT_BUFFER_SIZE];
+    bool probe;
 } mqtt_client_context_t;
 
+/* During a yield a read returns 0 unless data is ready, a packet once started is read in full */
+static int32_t mqtt_client_transport_recv(NetworkContext_t* network, void* buffer, size_t len)
+{
+    mqtt_client_context_t* context = (mqtt_client_context_t*)((uint8_t*)network - offsetof(mqtt_client_context_t, network));
+    size_t received = 0;
+
+    if (context->probe && network_tls_wait(network, 0) == 0) {
+        return 0;
+    }
+
+    while (received < len) {
+        int rv = network_tls_read(network, (unsigned char*)buffer + received, len - received);
+        if (rv < 0) {
+            return rv;
+        }
+        if (rv == 0) {
+            break;
+        }
+        received += rv;
+    }
+    return received;
+}
+
 static void core_mqtt_library_callback( struct MQTTContext* pContext,
                                         struct MQTTPacketInfo* pPacketInfo,
                                         struct MQTTDeserializedInfo* pDeserializedInfo )
@@ -124,7 +149,7 @@ mqtt_client_status_t mqtt_client_init(void* client, const mqtt_client_config_t*
     TransportInterface_t transport;
     transport.pNetworkContext = &context->network;
     transport.send = (TransportSend_t)network_tls_write;
-    transport.recv = (TransportRecv_t)network_tls_read;
+    transport.recv = (TransportRecv_t)mqtt_client_transport_recv;
 
     /* Fill the values for network buffer. */
     MQTTFixedBuffer_t network_buffer;
@@ -296,11 +321,32 @@ mqtt_client_status_t mqtt_client_yield(void* client)
     mqtt_client_context_t* context = (mqtt_client_context_t*)client;
     MQTTStatus_t mqtt_status;
 
-    mqtt_status = MQTT_ProcessLoop( &context->mqclient, context->config.timeout_ms);
+    /* With a zero timeout coreMQTT loops until a tick has passed, the probing reads keep
+     * that from blocking. Waiting is left to mqtt_client_wait. */
+    context->probe = true;
+    mqtt_status = MQTT_ProcessLoop( &context->mqclient, 0);
+    context->probe = false;
     if( mqtt_status != MQTTSuccess ) {
         log_error("MQTT_ProcessLoop returned with status = %s.", MQTT_Status_strerror( mqtt_status ));
         mqtt_client_disconnect(context);
         return MQTT_STATUS_NETWORK_TIMEOUT;
     }
     return MQTT_STATUS_SUCCESS;
-}
\ No newline at end of file
+}
+
+mqtt_client_status_t mqtt_client_wait(void* client, uint32_t timeout_ms)
+{
+    mqtt_client_context_t* context = (mqtt_client_context_t*)client;
+    MQTTContext_t* mqclient = &context->mqclient;
+
+    /* Wake up in time to send the keepalive ping, coreMQTT sends it once the interval has passed */
+    if (mqclient->keepAliveIntervalSec) {
+        uint32_t elapsed = system_ticks() - mqclient->lastPacketTime;
+        uint32_t interval = 1000U * mqclient->keepAliveIntervalSec + 1;
+        uint32_t keepalive_ms = elapsed < interval ? interval - elapsed : 0;
+        timeout_ms = keepalive_ms < timeout_ms ? keepalive_ms : timeout_ms;
+    }
+
+    network_tls_wait(&context->network, timeout_ms);
+    return MQTT_STATUS_SUCCESS;
+}
@@ -0,0 +1,338 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "mbedtls/aes.h"
+#include "tuya_error_code.h"
+#include "crypto_interface.h"
+#include "aes_inf.h"
+
+/*
+ * Host AES backend. x86-64 CPUs with AES-NI use the kernel below, anything
+ * else keeps the SDK software AES and its cached key schedules. Building with
+ * CRYPTO_AES_MBEDTLS_STANDIN=1 registers the bundled mbedTLS AES instead, as a
+ * stand-in for a hardware backend, to exercise the aes_method_register
+ * dispatch the way it runs on the device. It expands the key on every call.
+ * Modes left out of the mbedTLS config stay NULL and use the software AES.
+ */
+#ifndef CRYPTO_AES_MBEDTLS_STANDIN
+#define CRYPTO_AES_MBEDTLS_STANDIN 0
+#endif
+
+#if CRYPTO_AES_MBEDTLS_STANDIN
+
+static void mbedtls_aes128_ecb(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *out, int mode)
+{
+    mbedtls_aes_context ctx;
+    UINT_T i;
+
+    mbedtls_aes_init(&ctx);
+    if (MBEDTLS_AES_ENCRYPT == mode)
+    {
+        mbedtls_aes_setkey_enc(&ctx, key, 128);
+    }
+    else
+    {
+        mbedtls_aes_setkey_dec(&ctx, key, 128);
+    }
+    for (i = 0; i < len; i += 16)
+    {
+        mbedtls_aes_crypt_ecb(&ctx, mode, data + i, out + i);
+    }
+    mbedtls_aes_free(&ctx);
+}
+
+static void mbedtls_aes128_ecb_enc(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *ec_data)
+{
+    mbedtls_aes128_ecb(data, len, key, ec_data, MBEDTLS_AES_ENCRYPT);
+}
+
+static void mbedtls_aes128_ecb_dec(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *dec_data)
+{
+    mbedtls_aes128_ecb(data, len, key, dec_data, MBEDTLS_AES_DECRYPT);
+}
+
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+static void mbedtls_aes128_cbc(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *iv, uint8_t *out, int mode)
+{
+    mbedtls_aes_context ctx;
+
+    mbedtls_aes_init(&ctx);
+    if (MBEDTLS_AES_ENCRYPT == mode)
+    {
+        mbedtls_aes_setkey_enc(&ctx, key, 128);
+    }
+    else
+    {
+        mbedtls_aes_setkey_dec(&ctx, key, 128);
+    }
+    mbedtls_aes_crypt_cbc(&ctx, mode, len, iv, data, out);
+    mbedtls_aes_free(&ctx);
+}
+
+static void mbedtls_aes128_cbc_enc(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *iv, uint8_t *ec_data)
+{
+    mbedtls_aes128_cbc(data, len, key, iv, ec_data, MBEDTLS_AES_ENCRYPT);
+}
+
+static void mbedtls_aes128_cbc_dec(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *iv, uint8_t *dec_data)
+{
+    mbedtls_aes128_cbc(data, len, key, iv, dec_data, MBEDTLS_AES_DECRYPT);
+}
+#endif
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRYPTO_AESNI_ENABLE 1
+#endif
+
+#if CRYPTO_AESNI_ENABLE
+#include <wmmintrin.h>
+
+/*
+ * AES-NI kernel for x86-64 hosts, selected at runtime in crypto_aes_init.
+ * ECB and CBC decryption interleave four blocks to keep the AES unit busy.
+ */
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+#define AESNI_ROUNDS 10
+
+AESNI_TARGET static __m128i aesni_key_assist(__m128i key, __m128i assist)
+{
+    assist = _mm_shuffle_epi32(assist, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+AESNI_TARGET static void aesni_setkey_enc(const uint8_t *key, __m128i rk[AESNI_ROUNDS + 1])
+{
+    rk[0] = _mm_loadu_si128((const __m128i *)key);
+    rk[1] = aesni_key_assist(rk[0], _mm_aeskeygenassist_si128(rk[0], 0x01));
+    rk[2] = aesni_key_assist(rk[1], _mm_aeskeygenassist_si128(rk[1], 0x02));
+    rk[3] = aesni_key_assist(rk[2], _mm_aeskeygenassist_si128(rk[2], 0x04));
+    rk[4] = aesni_key_assist(rk[3], _mm_aeskeygenassist_si128(rk[3], 0x08));
+    rk[5] = aesni_key_assist(rk[4], _mm_aeskeygenassist_si128(rk[4], 0x10));
+    rk[6] = aesni_key_assist(rk[5], _mm_aeskeygenassist_si128(rk[5], 0x20));
+    rk[7] = aesni_key_assist(rk[6], _mm_aeskeygenassist_si128(rk[6], 0x40));
+    rk[8] = aesni_key_assist(rk[7], _mm_aeskeygenassist_si128(rk[7], 0x80));
+    rk[9] = aesni_key_assist(rk[8], _mm_aeskeygenassist_si128(rk[8], 0x1b));
+    rk[10] = aesni_key_assist(rk[9], _mm_aeskeygenassist_si128(rk[9], 0x36));
+}
+
+/* Equivalent inverse cipher schedule, in the order aesdec consumes it */
+AESNI_TARGET static void aesni_setkey_dec(const uint8_t *key, __m128i rk[AESNI_ROUNDS + 1])
+{
+    __m128i enc[AESNI_ROUNDS + 1];
+    int i;
+
+    aesni_setkey_enc(key, enc);
+    rk[0] = enc[AESNI_ROUNDS];
+    for (i = 1; i < AESNI_ROUNDS; i++)
+    {
+        rk[i] = _mm_aesimc_si128(enc[AESNI_ROUNDS - i]);
+    }
+    rk[AESNI_ROUNDS] = enc[0];
+}
+
+AESNI_TARGET static __m128i aesni_encrypt_block(const __m128i rk[AESNI_ROUNDS + 1], __m128i b)
+{
+    int r;
+
+    b = _mm_xor_si128(b, rk[0]);
+    for (r = 1; r < AESNI_ROUNDS; r++)
+    {
+        b = _mm_aesenc_si128(b, rk[r]);
+    }
+    return _mm_aesenclast_si128(b, rk[AESNI_ROUNDS]);
+}
+
+AESNI_TARGET static __m128i aesni_decrypt_block(const __m128i rk[AESNI_ROUNDS + 1], __m128i b)
+{
+    int r;
+
+    b = _mm_xor_si128(b, rk[0]);
+    for (r = 1; r < AESNI_ROUNDS; r++)
+    {
+        b = _mm_aesdec_si128(b, rk[r]);
+    }
+    return _mm_aesdeclast_si128(b, rk[AESNI_ROUNDS]);
+}
+
+AESNI_TARGET static void aesni_aes128_ecb(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *out, int mode)
+{
+    __m128i rk[AESNI_ROUNDS + 1];
+    __m128i b0, b1, b2, b3;
+    UINT_T i = 0;
+    int r;
+
+    if (MBEDTLS_AES_ENCRYPT == mode)
+    {
+        aesni_setkey_enc(key, rk);
+    }
+    else
+    {
+        aesni_setkey_dec(key, rk);
+    }
+
+    for (; i + 64 <= len; i += 64)
+    {
+        b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + i)), rk[0]);
+        b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + i + 16)), rk[0]);
+        b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + i + 32)), rk[0]);
+        b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + i + 48)), rk[0]);
+        if (MBEDTLS_AES_ENCRYPT == mode)
+        {
+            for (r = 1; r < AESNI_ROUNDS; r++)
+            {
+                b0 = _mm_aesenc_si128(b0, rk[r]);
+                b1 = _mm_aesenc_si128(b1, rk[r]);
+                b2 = _mm_aesenc_si128(b2, rk[r]);
+                b3 = _mm_aesenc_si128(b3, rk[r]);
+            }
+            b0 = _mm_aesenclast_si128(b0, rk[AESNI_ROUNDS]);
+            b1 = _mm_aesenclast_si128(b1, rk[AESNI_ROUNDS]);
+            b2 = _mm_aesenclast_si128(b2, rk[AESNI_ROUNDS]);
+            b3 = _mm_aesenclast_si128(b3, rk[AESNI_ROUNDS]);
+        }
+        else
+        {
+            for (r = 1; r < AESNI_ROUNDS; r++)
+            {
+                b0 = _mm_aesdec_si128(b0, rk[r]);
+                b1 = _mm_aesdec_si128(b1, rk[r]);
+                b2 = _mm_aesdec_si128(b2, rk[r]);
+                b3 = _mm_aesdec_si128(b3, rk[r]);
+            }
+            b0 = _mm_aesdeclast_si128(b0, rk[AESNI_ROUNDS]);
+            b1 = _mm_aesdeclast_si128(b1, rk[AESNI_ROUNDS]);
+            b2 = _mm_aesdeclast_si128(b2, rk[AESNI_ROUNDS]);
+            b3 = _mm_aesdeclast_si128(b3, rk[AESNI_ROUNDS]);
+        }
+        _mm_storeu_si128((__m128i *)(out + i), b0);
+        _mm_storeu_si128((__m128i *)(out + i + 16), b1);
+        _mm_storeu_si128((__m128i *)(out + i + 32), b2);
+        _mm_storeu_si128((__m128i *)(out + i + 48), b3);
+    }
+
+    for (; i < len; i += 16)
+    {
+        b0 = _mm_loadu_si128((const __m128i *)(data + i));
+        if (MBEDTLS_AES_ENCRYPT == mode)
+        {
+            b0 = aesni_encrypt_block(rk, b0);
+        }
+        else
+        {
+            b0 = aesni_decrypt_block(rk, b0);
+        }
+        _mm_storeu_si128((__m128i *)(out + i), b0);
+    }
+}
+
+AESNI_TARGET static void aesni_aes128_cbc_enc(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *iv, uint8_t *ec_data)
+{
+    __m128i rk[AESNI_ROUNDS + 1];
+    __m128i chain = _mm_loadu_si128((const __m128i *)iv);
+    UINT_T i;
+
+    /* Each block depends on the previous ciphertext, no interleaving here */
+    aesni_setkey_enc(key, rk);
+    for (i = 0; i < len; i += 16)
+    {
+        chain = _mm_xor_si128(chain, _mm_loadu_si128((const __m128i *)(data + i)));
+        chain = aesni_encrypt_block(rk, chain);
+        _mm_storeu_si128((__m128i *)(ec_data + i), chain);
+    }
+    _mm_storeu_si128((__m128i *)iv, chain);
+}
+
+AESNI_TARGET static void aesni_aes128_cbc_dec(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *iv, uint8_t *dec_data)
+{
+    __m128i rk[AESNI_ROUNDS + 1];
+    __m128i chain = _mm_loadu_si128((const __m128i *)iv);
+    __m128i c0, c1, c2, c3, b0, b1, b2, b3;
+    UINT_T i = 0;
+    int r;
+
+    aesni_setkey_dec(key, rk);
+
+    /* Ciphertext is loaded before any store, so data may alias dec_data */
+    for (; i + 64 <= len; i += 64)
+    {
+        c0 = _mm_loadu_si128((const __m128i *)(data + i));
+        c1 = _mm_loadu_si128((const __m128i *)(data + i + 16));
+        c2 = _mm_loadu_si128((const __m128i *)(data + i + 32));
+        c3 = _mm_loadu_si128((const __m128i *)(data + i + 48));
+        b0 = _mm_xor_si128(c0, rk[0]);
+        b1 = _mm_xor_si128(c1, rk[0]);
+        b2 = _mm_xor_si128(c2, rk[0]);
+        b3 = _mm_xor_si128(c3, rk[0]);
+        for (r = 1; r < AESNI_ROUNDS; r++)
+        {
+            b0 = _mm_aesdec_si128(b0, rk[r]);
+            b1 = _mm_aesdec_si128(b1, rk[r]);
+            b2 = _mm_aesdec_si128(b2, rk[r]);
+            b3 = _mm_aesdec_si128(b3, rk[r]);
+        }
+        b0 = _mm_xor_si128(_mm_aesdeclast_si128(b0, rk[AESNI_ROUNDS]), chain);
+        b1 = _mm_xor_si128(_mm_aesdeclast_si128(b1, rk[AESNI_ROUNDS]), c0);
+        b2 = _mm_xor_si128(_mm_aesdeclast_si128(b2, rk[AESNI_ROUNDS]), c1);
+        b3 = _mm_xor_si128(_mm_aesdeclast_si128(b3, rk[AESNI_ROUNDS]), c2);
+        _mm_storeu_si128((__m128i *)(dec_data + i), b0);
+        _mm_storeu_si128((__m128i *)(dec_data + i + 16), b1);
+        _mm_storeu_si128((__m128i *)(dec_data + i + 32), b2);
+        _mm_storeu_si128((__m128i *)(dec_data + i + 48), b3);
+        chain = c3;
+    }
+
+    for (; i < len; i += 16)
+    {
+        c0 = _mm_loadu_si128((const __m128i *)(data + i));
+        b0 = _mm_xor_si128(aesni_decrypt_block(rk, c0), chain);
+        _mm_storeu_si128((__m128i *)(dec_data + i), b0);
+        chain = c0;
+    }
+    _mm_storeu_si128((__m128i *)iv, chain);
+}
+
+static void aesni_aes128_ecb_enc(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *ec_data)
+{
+    aesni_aes128_ecb(data, len, key, ec_data, MBEDTLS_AES_ENCRYPT);
+}
+
+static void aesni_aes128_ecb_dec(const uint8_t *data, const UINT_T len, const uint8_t *key, uint8_t *dec_data)
+{
+    aesni_aes128_ecb(data, len, key, dec_data, MBEDTLS_AES_DECRYPT);
+}
+#endif
+
+int crypto_aes_init(void)
+{
+#if CRYPTO_AESNI_ENABLE
+    if (__builtin_cpu_supports("aes"))
+    {
+        AES_METHOD_REG_S aesni_method = {
+            .ecb_enc_128 = aesni_aes128_ecb_enc,
+            .ecb_dec_128 = aesni_aes128_ecb_dec,
+            .cbc_enc_128 = aesni_aes128_cbc_enc,
+            .cbc_dec_128 = aesni_aes128_cbc_dec,
+        };
+        return aes_method_register(&aesni_method, NULL);
+    }
+#endif
+
+#if CRYPTO_AES_MBEDTLS_STANDIN
+    AES_METHOD_REG_S method = {
+        .ecb_enc_128 = mbedtls_aes128_ecb_enc,
+        .ecb_dec_128 = mbedtls_aes128_ecb_dec,
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+        .cbc_enc_128 = mbedtls_aes128_cbc_enc,
+        .cbc_dec_128 = mbedtls_aes128_cbc_dec,
+#endif
+    };
+
+    return aes_method_register(&method, NULL);
+#else
+    return OPRT_OK;
+#endif
+}
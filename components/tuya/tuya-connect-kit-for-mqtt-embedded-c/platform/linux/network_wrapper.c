@@ -4,6 +4,9 @@ extern "C" {
 
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
 #include "log.h"
 #include "tuya_error_code.h"
 #include "network_interface.h"
@@ -42,6 +45,23 @@ struct tls_context {
 	uint32_t flags;
 };
 
+/* Number of endpoints whose TLS session is kept for resumption */
+#ifndef TLS_SESSION_CACHE_MAX
+#define TLS_SESSION_CACHE_MAX 4
+#endif
+
+#define TLS_SESSION_HOST_MAX 64
+
+typedef struct {
+	char host[TLS_SESSION_HOST_MAX];
+	uint16_t port;
+	bool valid;
+	mbedtls_ssl_session session;
+} tls_session_cache_t;
+
+static tls_session_cache_t s_session_cache[TLS_SESSION_CACHE_MAX];
+static uint8_t s_session_cache_next;
+
 static int mbedtls_random_port(void *p_rng, unsigned char *output, size_t output_len)
 {
     int i = 0;
@@ -51,6 +71,54 @@ static int mbedtls_random_port(void *p_rng, unsigned char *output, size_t output
     return 0;
 }
 
+/* Find the cached session of an endpoint, or take a slot for it */
+static tls_session_cache_t *tls_session_cache_find(const char *host, uint16_t port)
+{
+	tls_session_cache_t *entry = NULL;
+	int i;
+
+	if (strlen(host) >= TLS_SESSION_HOST_MAX) {
+		return NULL;
+	}
+
+	for (i = 0; i < TLS_SESSION_CACHE_MAX; i++) {
+		if (s_session_cache[i].port == port && strcmp(s_session_cache[i].host, host) == 0) {
+			return &s_session_cache[i];
+		}
+	}
+
+	/* Round robin replacement */
+	entry = &s_session_cache[s_session_cache_next];
+	s_session_cache_next = (s_session_cache_next + 1) % TLS_SESSION_CACHE_MAX;
+
+	if (entry->valid) {
+		mbedtls_ssl_session_free(&entry->session);
+	}
+	memset(entry, 0, sizeof(tls_session_cache_t));
+	mbedtls_ssl_session_init(&entry->session);
+	strcpy(entry->host, host);
+	entry->port = port;
+	return entry;
+}
+
+static void tls_session_cache_invalidate(tls_session_cache_t *entry)
+{
+	if (entry && entry->valid) {
+		mbedtls_ssl_session_free(&entry->session);
+		mbedtls_ssl_session_init(&entry->session);
+		entry->valid = false;
+	}
+}
+
+/* Remember the negotiated session so the next connect can resume it */
+static void tls_session_cache_store(tls_session_cache_t *entry, const mbedtls_ssl_context *ssl)
+{
+	tls_session_cache_invalidate(entry);
+	if (mbedtls_ssl_get_session(ssl, &entry->session) == 0) {
+		entry->valid = true;
+	}
+}
+
 int network_tls_init(NetworkContext_t *pNetwork, const TLSConnectParams *params)
 {
 	if (NULL == pNetwork) {
@@ -71,6 +139,8 @@ int network_tls_init(NetworkContext_t *pNetwork, const TLSConnectParams *params)
 	}
 
 	tls_ctx->flags = 0;
+	/* No socket until connected, network_tls_wait checks the fd */
+	mbedtls_net_init(&tls_ctx->server_fd);
 	pNetwork->context = tls_ctx;
 	return OPRT_OK;
 }
@@ -79,6 +149,7 @@ int network_tls_connect(NetworkContext_t *pNetwork, const TLSConnectParams *para
 {
 	int ret = 0;
 	tls_context_t *tlsDataParams = NULL;
+	tls_session_cache_t *session = NULL;
 	char portBuffer[6];
 
 	if(NULL == pNetwork) {
@@ -195,6 +266,16 @@ int network_tls_connect(NetworkContext_t *pNetwork, const TLSConnectParams *para
 		return OPRT_MID_TLS_CONNECTION_ERROR;
 	}
 
+	/* Offer the last session of this endpoint for an abbreviated handshake */
+	session = tls_session_cache_find(pNetwork->tlsConnectParams.host, pNetwork->tlsConnectParams.port);
+	if (session && session->valid) {
+		log_debug("Resuming cached TLS session...");
+		if ((ret = mbedtls_ssl_set_session(&(tlsDataParams->ssl), &session->session)) != 0) {
+			log_warn("mbedtls_ssl_set_session returned -0x%x", -ret);
+			tls_session_cache_invalidate(session);
+		}
+	}
+
 	log_debug("SSL state connect: %d ", tlsDataParams->ssl.state);
 	log_debug("Performing the SSL/TLS handshake...");
 	while((ret = mbedtls_ssl_handshake(&(tlsDataParams->ssl))) != 0) {
@@ -209,11 +290,15 @@ int network_tls_connect(NetworkContext_t *pNetwork, const TLSConnectParams *para
 							  "auth_mode=optional for testing purposes.\n");
 			}
 			mbedtls_x509_crt_free(&(tlsDataParams->cacert));
+			tls_session_cache_invalidate(session);
 			return OPRT_MID_TLS_CONNECTION_ERROR;
 		}
 	}
 
 	log_debug("TLS handshake complete.");
+	if (session) {
+		tls_session_cache_store(session, &(tlsDataParams->ssl));
+	}
 	log_debug("Release CA x509 parse.");
 	mbedtls_x509_crt_free(&(tlsDataParams->cacert));
 
@@ -293,6 +378,62 @@ int network_tls_read(NetworkContext_t *pNetwork, unsigned char *pMsg, size_t len
     return rv;
 }
 
+/* Self-pipe, a byte on it ends network_tls_wait early */
+static int s_wake_pipe[2] = {-1, -1};
+
+void network_wakeup(void)
+{
+    if (s_wake_pipe[1] >= 0) {
+        (void)write(s_wake_pipe[1], "w", 1);
+    }
+}
+
+int network_tls_wait(NetworkContext_t *pNetwork, uint32_t timeout_ms)
+{
+    tls_context_t *tlsDataParams = pNetwork ? (tls_context_t*)(pNetwork->context) : NULL;
+    int fd = tlsDataParams ? tlsDataParams->server_fd.fd : -1;
+    char drain[64];
+    fd_set readfds;
+    int maxfd = -1;
+
+    /* Records already decrypted or buffered by mbedTLS never show on the socket */
+    if (fd >= 0 &&
+        (mbedtls_ssl_get_bytes_avail(&tlsDataParams->ssl) > 0 || mbedtls_ssl_check_pending(&tlsDataParams->ssl))) {
+        return 1;
+    }
+
+    if (s_wake_pipe[0] < 0 && pipe(s_wake_pipe) == 0) {
+        fcntl(s_wake_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(s_wake_pipe[1], F_SETFL, O_NONBLOCK);
+    }
+
+    FD_ZERO(&readfds);
+    if (fd >= 0) {
+        FD_SET(fd, &readfds);
+        maxfd = fd;
+    }
+    /* A zero timeout only polls the connection, a pending wakeup is kept for the next wait */
+    if (s_wake_pipe[0] >= 0 && timeout_ms) {
+        FD_SET(s_wake_pipe[0], &readfds);
+        maxfd = s_wake_pipe[0] > maxfd ? s_wake_pipe[0] : maxfd;
+    }
+
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    if (select(maxfd + 1, &readfds, NULL, NULL, &tv) <= 0) {
+        return 0;
+    }
+
+    if (s_wake_pipe[0] >= 0 && FD_ISSET(s_wake_pipe[0], &readfds)) {
+        while (read(s_wake_pipe[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+
+    return fd >= 0 && FD_ISSET(fd, &readfds) ? 1 : 0;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "tuya_error_code.h"
+#include "ota_interface.h"
+#include "system_interface.h"
+
+/* Host stand-in for the flash partition, the image is renamed into place once complete */
+#ifndef OTA_SINK_FILE_PATH
+#define OTA_SINK_FILE_PATH "ota_image.bin"
+#endif
+
+#define OTA_SINK_TEMP_PATH OTA_SINK_FILE_PATH ".part"
+
+/* Delta updates are made against the running program by default */
+#ifndef OTA_SOURCE_FILE_PATH
+#define OTA_SOURCE_FILE_PATH "/proc/self/exe"
+#endif
+
+int ota_sink_begin(size_t image_size, size_t offset, void** handle)
+{
+    if (NULL == handle || offset > image_size) {
+        return OPRT_INVALID_PARM;
+    }
+
+    FILE* fptr = fopen(OTA_SINK_TEMP_PATH, offset ? "r+b" : "wb");
+    if (NULL == fptr) {
+        log_error("open %s error", OTA_SINK_TEMP_PATH);
+        return OPRT_COM_ERROR;
+    }
+
+    /* Drop whatever was written after the resume point */
+    if (offset && (ftruncate(fileno(fptr), offset) != 0 || fseek(fptr, offset, SEEK_SET) != 0)) {
+        log_error("resume %s at %d error", OTA_SINK_TEMP_PATH, (int)offset);
+        fclose(fptr);
+        return OPRT_COM_ERROR;
+    }
+
+    log_info("writing %d bytes from %d to %s", (int)image_size, (int)offset, OTA_SINK_TEMP_PATH);
+    *handle = fptr;
+    return OPRT_OK;
+}
+
+int ota_sink_write(void* handle, const uint8_t* data, size_t len)
+{
+    if (NULL == handle || NULL == data) {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (fwrite(data, 1, len, (FILE*)handle) != len) {
+        log_error("write error");
+        return OPRT_COM_ERROR;
+    }
+    return OPRT_OK;
+}
+
+int ota_sink_sync(void* handle)
+{
+    if (NULL == handle) {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (fflush((FILE*)handle) != 0) {
+        log_error("flush error");
+        return OPRT_COM_ERROR;
+    }
+    return OPRT_OK;
+}
+
+int ota_sink_finish(void* handle)
+{
+    if (NULL == handle) {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (fclose((FILE*)handle) != 0) {
+        log_error("close error");
+        remove(OTA_SINK_TEMP_PATH);
+        return OPRT_COM_ERROR;
+    }
+
+    if (rename(OTA_SINK_TEMP_PATH, OTA_SINK_FILE_PATH) != 0) {
+        log_error("rename error");
+        return OPRT_COM_ERROR;
+    }
+    return OPRT_OK;
+}
+
+int ota_sink_abort(void* handle)
+{
+    if (NULL == handle) {
+        return OPRT_INVALID_PARM;
+    }
+
+    fclose((FILE*)handle);
+    return OPRT_OK;
+}
+
+int ota_source_read(size_t offset, uint8_t* buffer, size_t len)
+{
+    if (NULL == buffer) {
+        return OPRT_INVALID_PARM;
+    }
+
+    FILE* fptr = fopen(OTA_SOURCE_FILE_PATH, "rb");
+    if (NULL == fptr) {
+        log_error("open %s error", OTA_SOURCE_FILE_PATH);
+        return OPRT_COM_ERROR;
+    }
+
+    int rt = OPRT_OK;
+    if (fseek(fptr, offset, SEEK_SET) != 0 || fread(buffer, 1, len, fptr) != len) {
+        log_error("read %s at %d error", OTA_SOURCE_FILE_PATH, (int)offset);
+        rt = OPRT_COM_ERROR;
+    }
+    fclose(fptr);
+    return rt;
+}
@@ -6,6 +6,7 @@ extern "C" {
 #include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 #include "system_interface.h"
 
@@ -62,6 +63,11 @@ uint32_t system_random(void)
     return (uint32_t)rand();
 }
 
+void* system_thread_self(void)
+{
+    return (void*)pthread_self();
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -132,18 +132,18 @@ static int atop_request_data_encode(const char *key,
 }
 
 static int atop_response_result_decrpyt(const char *key,
-                                        const uint8_t *input, int ilen,
-                                        uint8_t *output, size_t *olen)
+                                        uint8_t *data, size_t len,
+                                        size_t *olen)
 {
-    if (key == NULL || input == NULL || ilen == 0 || output == NULL || olen == NULL)
+    if (key == NULL || data == NULL || len == 0 || olen == NULL)
     {
         return OPRT_INVALID_PARM;
     }
 
     int rt = OPRT_OK;
 
-    // AES decrypt
-    rt = aes128_ecb_decode_raw(input, ilen, output, (const uint8_t *)key);
+    // AES decrypt in place
+    rt = aes128_ecb_decode_raw(data, len, data, (const uint8_t *)key);
     if (rt != OPRT_OK)
     {
         TY_LOGE("aes128_ecb_decode error:%d", rt);
@@ -151,15 +151,23 @@ static int atop_response_result_decrpyt(const char *key,
     }
 
     /* PKCS7 unpadding */
-    *olen = ilen - output[ilen - 1];
-    output[*olen] = 0;
+    uint8_t padding_value = data[len - 1];
+    if (padding_value == 0 || padding_value > AES_BLOCK_SIZE)
+    {
+        TY_LOGE("PKCS7 padding error:%d", padding_value);
+        return OPRT_COM_ERROR;
+    }
+    *olen = len - padding_value;
+    data[*olen] = 0;
 
     return rt;
 }
 
+/* Base64 decode and decrypt the "result" value in place, the plaintext is
+ * left NUL terminated inside the input buffer at *output. */
 static int atop_response_data_decode(const char *key,
-                                     const uint8_t *input, size_t ilen,
-                                     uint8_t *output, size_t *olen)
+                                     uint8_t *input, size_t ilen,
+                                     uint8_t **output, size_t *olen)
 {
     int rt = OPRT_OK;
 
@@ -185,28 +193,31 @@ static int atop_response_data_decode(const char *key,
     }
     TY_LOGV("base64 encode result:\r\n%.*s", value_length, value);
 
-    // base64 decode buffer
-    size_t b64buffer_len = value_length * 3 / 4;
-    uint8_t *b64buffer = system_malloc(b64buffer_len);
-    size_t b64buffer_olen = 0;
+    // validate the base64 and get the cipher length, the buffer is still untouched
+    size_t cipher_len = 0;
+    rt = mbedtls_base64_decode(NULL, 0, &cipher_len, (const uint8_t *)value, value_length);
+    if (rt != MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL || cipher_len == 0 || cipher_len % AES_BLOCK_SIZE != 0)
+    {
+        TY_LOGE("base64 decode error:%d", rt);
+        return OPRT_COM_ERROR;
+    }
 
-    // base64 decode
-    rt = mbedtls_base64_decode(b64buffer, b64buffer_len, &b64buffer_olen, (const uint8_t *)value, value_length);
+    // base64 decode in place, the output never overtakes the input
+    rt = mbedtls_base64_decode((uint8_t *)value, value_length, &cipher_len, (const uint8_t *)value, value_length);
     if (rt != OPRT_OK)
     {
         TY_LOGE("base64 decode error:%d", rt);
-        system_free(b64buffer);
         return rt;
     }
 
-    rt = atop_response_result_decrpyt(key, (const uint8_t *)b64buffer, b64buffer_olen, output, olen);
-    system_free(b64buffer);
+    rt = atop_response_result_decrpyt(key, (uint8_t *)value, cipher_len, olen);
     if (rt != OPRT_OK)
     {
         TY_LOGE("atop_data_decrpyt error: %d", rt);
         return rt;
     }
-    TY_LOGV("result:\r\n%.*s", *olen, output);
+    *output = (uint8_t *)value;
+    TY_LOGV("result:\r\n%.*s", *olen, *output);
 
     return rt;
 }
@@ -437,25 +448,18 @@ int atop_base_request(const atop_base_request_t *request, atop_base_response_t *
         return OPRT_LINK_CORE_HTTP_CLIENT_SEND_ERROR;
     }
 
+    /* Decoded response data, in place in the response buffer which
+     * http_response.body points into */
+    uint8_t *result_buffer = NULL;
     size_t result_buffer_length = 0;
-    uint8_t *result_buffer = system_calloc(1, http_response.body_length);
-    if (NULL == result_buffer)
-    {
-        TY_LOGE("result_buffer malloc fail");
-        system_free(response_buffer);
-        return OPRT_MALLOC_FAILED;
-    }
-
-    /* Decoded response data */
     rt = atop_response_data_decode(request->key,
-                                   http_response.body, http_response.body_length,
-                                   result_buffer, &result_buffer_length);
+                                   (uint8_t *)http_response.body, http_response.body_length,
+                                   &result_buffer, &result_buffer_length);
 
     if (OPRT_OK == rt)
     {
         rt = atop_response_result_parse_cjson(result_buffer, result_buffer_length, response);
         system_free(response_buffer);
-        system_free(result_buffer);
         return rt;
     }
 
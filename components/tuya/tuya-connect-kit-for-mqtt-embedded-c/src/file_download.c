@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -8,6 +9,7 @@
 
 #include "system_interface.h"
 #include "file_download.h"
+#include "http_client_interface.h"
 #include "tuya_iot.h"
 #include "MultiTimer.h"
 
@@ -22,6 +24,15 @@ typedef enum
     DL_STATE_FAULT,
 } file_download_state_t;
 
+typedef enum
+{
+    RANGE_STATE_FREE,
+    RANGE_STATE_PENDING,
+    RANGE_STATE_READY,
+    RANGE_STATE_FAILED,
+    RANGE_STATE_STALE,
+} file_download_range_state_t;
+
 /*-----------------------------------------------------------*/
 /**
  * @brief The size of the range of the file to download, with each request.
@@ -29,6 +40,18 @@ typedef enum
  */
 #define RANGE_REQUEST_LENGTH_DEFAULT (1024)
 
+/**
+ * @brief Number of range requests in flight, when not configured.
+ *
+ */
+#define RANGE_WINDOW_SIZE_DEFAULT (1)
+
+/**
+ * @brief Bytes a range grows by after a window of timely answers.
+ *
+ */
+#define RANGE_LENGTH_STEP (256)
+
 /**
  * @brief Retry requset times config.
  *
@@ -36,35 +59,185 @@ typedef enum
 #define MAX_DL_RETRY_TIMES (8u)
 
 /*-----------------------------------------------------------*/
+static void file_download_window_reset(file_download_context_t *ctx)
+{
+    int i;
+    for (i = 0; i < ctx->config.window_size; i++)
+    {
+        file_download_range_t *range = &ctx->range[i];
+        /* A pending request still owns its slot until matop answers or times it out */
+        range->state = (range->state == RANGE_STATE_PENDING) ? RANGE_STATE_STALE : RANGE_STATE_FREE;
+        range->retry = 0;
+    }
+    ctx->request_offset = ctx->received_size;
+}
+
+/* Size ranges like TCP sizes its window: grow slowly while answers come back
+ * well inside the timeout, halve on every loss. */
+static void file_download_range_adapt(file_download_context_t *ctx, file_download_range_t *range, bool success)
+{
+    if (success == false)
+    {
+        ctx->range_length = ctx->range_length / 2 > FILE_DOWNLOAD_RANGE_MIN ? ctx->range_length / 2 : FILE_DOWNLOAD_RANGE_MIN;
+        ctx->range_acked = 0;
+        TY_LOGD("range length down to %d", ctx->range_length);
+        return;
+    }
+
+    uint32_t rtt = system_ticks() - range->request_time;
+    uint32_t timeout_ms = ctx->config.timeout_ms ? ctx->config.timeout_ms : MATOP_TIMEOUT_MS_DEFAULT;
+    ctx->rtt = ctx->rtt ? (ctx->rtt * 7 + rtt) / 8 : rtt;
+
+    if (++ctx->range_acked >= ctx->config.window_size && ctx->rtt < timeout_ms / 2)
+    {
+        ctx->range_acked = 0;
+        if (ctx->range_length < FILE_DOWNLOAD_RANGE_MAX)
+        {
+            ctx->range_length = ctx->range_length + RANGE_LENGTH_STEP < FILE_DOWNLOAD_RANGE_MAX ? ctx->range_length + RANGE_LENGTH_STEP : FILE_DOWNLOAD_RANGE_MAX;
+            TY_LOGD("range length up to %d, rtt:%" PRIu32, ctx->range_length, ctx->rtt);
+        }
+    }
+}
+
+static void file_download_rate_update(file_download_context_t *ctx, size_t len)
+{
+    uint32_t elapsed = system_ticks() - ctx->rate_time;
+
+    ctx->rate_bytes += len;
+    if (elapsed >= 1000)
+    {
+        ctx->rate = ctx->rate_bytes * 1000 / elapsed;
+        ctx->rate_bytes = 0;
+        ctx->rate_time += elapsed;
+    }
+}
+
 static void file_download_data_on(const uint8_t *data, size_t len, void *user_data)
 {
     file_download_context_t *ctx = (file_download_context_t *)user_data;
+    size_t offset = ctx->received_size;
+
+    file_download_rate_update(ctx, len);
 
+    ctx->event.offset = offset;
     if (ctx->config.event_handler)
     {
         ctx->event.id = DL_EVENT_ON_DATA;
         ctx->event.data = (uint8_t *)data;
         ctx->event.data_len = len;
-        ctx->event.offset = ctx->received_size;
+        ctx->event.range_length = ctx->https ? FILE_DOWNLOAD_HTTPS_RANGE_LENGTH : ctx->range_length;
+        ctx->event.rate = ctx->rate;
         ctx->config.event_handler(ctx, &ctx->event);
+        if (ctx->state == DL_STATE_IDLE)
+        {
+            return;
+        }
     }
     ctx->received_size = ctx->event.offset + len;
     ctx->retry = 0;
+
+    /* The handler moved the offset, ranges already in the window are no longer next */
+    if (ctx->event.offset != offset)
+    {
+        file_download_window_reset(ctx);
+    }
+}
+
+static file_download_range_t *file_download_range_next_ready(file_download_context_t *ctx)
+{
+    int i;
+    for (i = 0; i < ctx->config.window_size; i++)
+    {
+        if (ctx->range[i].state == RANGE_STATE_READY && ctx->range[i].offset == ctx->received_size)
+        {
+            return &ctx->range[i];
+        }
+    }
+    return NULL;
 }
 
 static void file_donwload_data_recv_cb(atop_base_response_t *response, void *user_data)
 {
-    file_download_context_t *ctx = (file_download_context_t *)user_data;
+    file_download_range_t *range = (file_download_range_t *)user_data;
+    file_download_context_t *ctx = range->ctx;
 
-    if (response->success == false)
+    if (range->state == RANGE_STATE_STALE)
     {
+        range->state = RANGE_STATE_FREE;
+        file_download_yield(ctx);
+        return;
+    }
+
+    if (response->success == false || response->raw_data_len != range->length)
+    {
+        TY_LOGW("range %d-%d failed, retry:%d", range->offset, range->offset + range->length - 1, range->retry);
+        file_download_range_adapt(ctx, range, false);
+        range->state = RANGE_STATE_FAILED;
+        range->retry++;
         ctx->retry++;
         MultiTimerStart(&ctx->timer, 5000);
         return;
     }
+    file_download_range_adapt(ctx, range, true);
 
-    file_download_data_on(response->raw_data, response->raw_data_len, user_data);
-    file_download_yield((file_download_context_t *)user_data);
+    if (range->offset != ctx->received_size)
+    {
+        /* Arrived ahead of an earlier range, hold it until the gap is filled */
+        if (range->buffer_size < range->length)
+        {
+            system_free(range->buffer);
+            range->buffer_size = 0;
+            range->buffer = system_malloc(range->length);
+            if (range->buffer == NULL)
+            {
+                TY_LOGE("range buffer malloc fail");
+                range->state = RANGE_STATE_FAILED;
+                range->retry++;
+                MultiTimerStart(&ctx->timer, 5000);
+                return;
+            }
+            range->buffer_size = range->length;
+        }
+        memcpy(range->buffer, response->raw_data, range->length);
+        range->state = RANGE_STATE_READY;
+        return;
+    }
+
+    range->state = RANGE_STATE_FREE;
+    file_download_data_on(response->raw_data, response->raw_data_len, ctx);
+
+    /* Flush the ranges that are now in order, unless the handler stopped the download */
+    while (ctx->state != DL_STATE_IDLE && (range = file_download_range_next_ready(ctx)) != NULL)
+    {
+        range->state = RANGE_STATE_FREE;
+        file_download_data_on(range->buffer, range->length, ctx);
+    }
+
+    file_download_yield(ctx);
+}
+
+static int file_download_range_request(file_download_context_t *ctx, file_download_range_t *range)
+{
+    int ret = matop_service_file_download_range(ctx->config.transport,
+                                                ctx->config.url,
+                                                range->offset,
+                                                range->offset + range->length - 1,
+                                                ctx->config.timeout_ms,
+                                                file_donwload_data_recv_cb,
+                                                range);
+    if (ret != OPRT_OK)
+    {
+        TY_LOGW("file download range get error:%d, goto retry", ret);
+        range->state = RANGE_STATE_FAILED;
+        range->retry++;
+        ctx->retry++;
+        MultiTimerStart(&ctx->timer, 5000);
+        return ret;
+    }
+
+    range->state = RANGE_STATE_PENDING;
+    range->request_time = system_ticks();
+    return OPRT_OK;
 }
 
 static void file_size_result_recv_cb(atop_base_response_t *response, void *user_data)
@@ -78,14 +251,147 @@ static void file_download_retry_timer_cb(MultiTimer *timer, void *user_data)
     file_download_context_t *ctx = (file_download_context_t *)user_data;
 
     TY_LOGD("On timer retry:%d", ctx->retry);
-    if (ctx->retry > MAX_DL_RETRY_TIMES)
+    int i;
+    for (i = 0; i < ctx->config.window_size; i++)
     {
-        ctx->state = DL_STATE_FAULT;
+        if (ctx->range[i].retry > MAX_DL_RETRY_TIMES)
+        {
+            ctx->state = DL_STATE_FAULT;
+        }
     }
     TY_LOGD("go retry request");
     file_download_yield((file_download_context_t *)user_data);
 }
 
+/*-----------------------------------------------------------*/
+/**
+ * @brief Room for the response headers next to an HTTPS range body.
+ *
+ */
+#define HTTPS_HEADER_BUFFER_LENGTH (1024)
+
+static int file_download_https_setup(file_download_context_t *ctx, const char *url)
+{
+    int port = 443;
+    const char *host = url + strlen("https://");
+    const char *path = strchr(host, '/');
+    size_t host_len = path ? (size_t)(path - host) : strlen(host);
+    const char *colon = memchr(host, ':', host_len);
+
+    if (colon)
+    {
+        port = atoi(colon + 1);
+        host_len = colon - host;
+    }
+    if (host_len == 0 || host_len >= sizeof(ctx->https_host) || port <= 0 || port > 0xffff)
+    {
+        return OPRT_INVALID_PARM;
+    }
+
+    ctx->https_buffer = system_malloc(FILE_DOWNLOAD_HTTPS_RANGE_LENGTH + HTTPS_HEADER_BUFFER_LENGTH);
+    ctx->config.https_url = system_malloc(strlen(url) + 1);
+    if (ctx->https_buffer == NULL || ctx->config.https_url == NULL)
+    {
+        system_free(ctx->https_buffer);
+        system_free(ctx->config.https_url);
+        ctx->https_buffer = NULL;
+        ctx->config.https_url = NULL;
+        return OPRT_MALLOC_FAILED;
+    }
+    strcpy(ctx->config.https_url, url);
+
+    memcpy(ctx->https_host, host, host_len);
+    ctx->https_host[host_len] = '\0';
+    ctx->https_port = (uint16_t)port;
+    ctx->https_path = path ? ctx->config.https_url + (path - url) : "/";
+    ctx->https = true;
+    return OPRT_OK;
+}
+
+static void file_download_https_close(file_download_context_t *ctx)
+{
+    ctx->https = false;
+    MultiTimerStop(&ctx->https_timer);
+    if (ctx->https_buffer)
+    {
+        system_free(ctx->https_buffer);
+        ctx->https_buffer = NULL;
+    }
+}
+
+static int file_download_https_range_get(file_download_context_t *ctx)
+{
+    size_t request_size = (ctx->file_size - ctx->received_size) > FILE_DOWNLOAD_HTTPS_RANGE_LENGTH ? FILE_DOWNLOAD_HTTPS_RANGE_LENGTH : (ctx->file_size - ctx->received_size);
+    char range[40];
+
+    snprintf(range, sizeof(range), "bytes=%d-%d", (int)ctx->received_size, (int)(ctx->received_size + request_size - 1));
+    http_client_header_t headers[] = {
+        {.key = "Range", .value = range},
+    };
+    http_client_response_t response = {
+        .buffer = ctx->https_buffer,
+        .buffer_length = FILE_DOWNLOAD_HTTPS_RANGE_LENGTH + HTTPS_HEADER_BUFFER_LENGTH};
+
+    /* The TLS connection stays open between ranges through the http client keep-alive pool */
+    http_client_status_t status = http_client_request(
+        &(const http_client_request_t){
+            .cacert = ctx->config.cacert,
+            .cacert_len = ctx->config.cacert_len,
+            .host = ctx->https_host,
+            .port = ctx->https_port,
+            .method = "GET",
+            .path = ctx->https_path,
+            .headers = headers,
+            .headers_count = sizeof(headers) / sizeof(http_client_header_t),
+            .timeout_ms = ctx->config.timeout_ms ? ctx->config.timeout_ms : HTTP_TIMEOUT_MS_DEFAULT,
+        },
+        &response);
+    if (HTTP_CLIENT_SUCCESS != status)
+    {
+        TY_LOGW("https range %s error:%d", range, status);
+        return OPRT_LINK_CORE_HTTP_CLIENT_SEND_ERROR;
+    }
+
+    /* A server ignoring Range answers 200 with the whole file, only usable if that is this range */
+    bool whole = response.status_code == 200 && ctx->received_size == 0 && request_size == ctx->file_size;
+    if ((response.status_code != 206 && !whole) || response.body_length != request_size)
+    {
+        TY_LOGW("https range %s status:%d, len:%d", range, response.status_code, response.body_length);
+        return OPRT_COM_ERROR;
+    }
+
+    file_download_data_on(response.body, response.body_length, ctx);
+    return OPRT_OK;
+}
+
+static void file_download_https_timer_cb(MultiTimer *timer, void *user_data)
+{
+    file_download_context_t *ctx = (file_download_context_t *)user_data;
+
+    if (ctx->state != DL_STATE_DATE_GET || !ctx->https)
+    {
+        return;
+    }
+
+    if (file_download_https_range_get(ctx) == OPRT_OK)
+    {
+        ctx->https_retry = 0;
+    }
+    else if (++ctx->https_retry >= FILE_DOWNLOAD_HTTPS_RETRY_MAX)
+    {
+        TY_LOGW("https download failed, fall back to mqtt at %d", ctx->received_size);
+        file_download_https_close(ctx);
+        ctx->request_offset = ctx->received_size;
+    }
+    else
+    {
+        MultiTimerStart(&ctx->https_timer, 1000);
+        return;
+    }
+
+    file_download_yield(ctx);
+}
+
 int file_download_init(file_download_context_t *ctx, const file_download_config_t *config)
 {
     int ret = OPRT_OK;
@@ -94,16 +400,42 @@ int file_download_init(file_download_context_t *ctx, const file_download_config_
 
     ctx->config = *config;
     ctx->file_size = config->file_size;
+    ctx->received_size = config->offset;
 
     if (ctx->config.range_length == 0)
     {
         ctx->config.range_length = RANGE_REQUEST_LENGTH_DEFAULT;
     }
+    ctx->range_length = ctx->config.range_length > FILE_DOWNLOAD_RANGE_MAX ? FILE_DOWNLOAD_RANGE_MAX : ctx->config.range_length;
+
+    if (ctx->config.window_size == 0)
+    {
+        ctx->config.window_size = RANGE_WINDOW_SIZE_DEFAULT;
+    }
+    else if (ctx->config.window_size > FILE_DOWNLOAD_WINDOW_MAX)
+    {
+        ctx->config.window_size = FILE_DOWNLOAD_WINDOW_MAX;
+    }
+
+    int i;
+    for (i = 0; i < FILE_DOWNLOAD_WINDOW_MAX; i++)
+    {
+        ctx->range[i].ctx = ctx;
+    }
 
     ctx->config.url = system_malloc(strlen(config->url) + 1);
     sprintf(ctx->config.url, "%s", config->url);
 
     MultiTimerInit(&ctx->timer, 0, file_download_retry_timer_cb, ctx);
+    MultiTimerInit(&ctx->https_timer, 0, file_download_https_timer_cb, ctx);
+
+    /* Prefer a direct HTTPS download when the image has one, MQTT stays the fallback */
+    ctx->config.https_url = NULL;
+    if (config->https_url && strncmp(config->https_url, "https://", strlen("https://")) == 0 &&
+        file_download_https_setup(ctx, config->https_url) != OPRT_OK)
+    {
+        TY_LOGW("https url unusable, download over mqtt");
+    }
 
     ctx->state = DL_STATE_IDLE;
     ctx->nextstate = DL_STATE_START;
@@ -124,6 +456,7 @@ int file_download_stop(file_download_context_t *ctx)
     int ret = OPRT_OK;
     ctx->nextstate = ctx->state;
     ctx->state = DL_STATE_IDLE;
+    file_download_window_reset(ctx);
     return ret;
 }
 
@@ -132,6 +465,7 @@ int file_download_suspend(file_download_context_t *ctx)
     int ret = OPRT_OK;
     ctx->nextstate = ctx->state;
     ctx->state = DL_STATE_IDLE;
+    file_download_window_reset(ctx);
     return ret;
 }
 
@@ -151,6 +485,10 @@ int file_download_yield(file_download_context_t *ctx)
             ctx->event.id = DL_EVENT_START;
             ctx->event.user_data = ctx->config.user_data;
             ctx->config.event_handler(ctx, &ctx->event);
+            if (ctx->state == DL_STATE_IDLE)
+            {
+                break;
+            }
         }
         ctx->state = (file_download_state_t)DL_STATE_FILESIZE_GET;
     /* FALLTHROUGH */
@@ -165,14 +503,20 @@ int file_download_yield(file_download_context_t *ctx)
                                                     ctx->config.timeout_ms,
                                                     file_size_result_recv_cb,
                                                     ctx);
+            if (ret != OPRT_OK)
+            {
+                TY_LOGW("file size get error:%d, goto retry", ret);
+                ctx->state = ++ctx->retry > MAX_DL_RETRY_TIMES ? DL_STATE_FAULT : DL_STATE_FILESIZE_GET;
+                MultiTimerStart(&ctx->timer, 5000);
+            }
             break;
         }
         TY_LOGI("file_size:%d", ctx->file_size);
 
         /* 如果文件体积小于单次 range 长度，那就调整 range 长度 */
-        if (ctx->file_size < ctx->config.range_length)
+        if (ctx->file_size < ctx->range_length)
         {
-            ctx->config.range_length = ctx->file_size;
+            ctx->range_length = ctx->file_size;
         }
 
         if (ctx->config.event_handler)
@@ -180,8 +524,14 @@ int file_download_yield(file_download_context_t *ctx)
             ctx->event.id = DL_EVENT_ON_FILESIZE;
             ctx->event.file_size = ctx->file_size;
             ctx->config.event_handler(ctx, &ctx->event);
+            if (ctx->state == DL_STATE_IDLE)
+            {
+                break;
+            }
         }
         ctx->retry = 0;
+        ctx->request_offset = ctx->received_size;
+        ctx->rate_time = system_ticks();
         ctx->state = DL_STATE_DATE_GET;
         // break;
         /* FALLTHROUGH */
@@ -190,21 +540,48 @@ int file_download_yield(file_download_context_t *ctx)
         /* File download complete? */
         if (ctx->received_size < ctx->file_size)
         {
-            size_t request_size = (ctx->file_size - ctx->received_size) > ctx->config.range_length ? (ctx->config.range_length) : (ctx->file_size - ctx->received_size);
+            /* One blocking range per loop, so MQTT is still served between ranges */
+            if (ctx->https)
+            {
+                if (!MultiTimerActivated(&ctx->https_timer))
+                {
+                    MultiTimerStart(&ctx->https_timer, 0);
+                }
+                return DL_STATUS_EAGAIN;
+            }
 
-            ret = matop_service_file_download_range(ctx->config.transport,
-                                                    ctx->config.url,
-                                                    ctx->received_size,
-                                                    ctx->received_size + request_size - 1,
-                                                    ctx->config.timeout_ms,
-                                                    file_donwload_data_recv_cb,
-                                                    ctx);
-            if (ret != OPRT_OK)
+            int i;
+            for (i = 0; i < ctx->config.window_size; i++)
             {
-                TY_LOGW("file download range get error:%d, goto retry", ret);
-                ctx->retry++;
-                MultiTimerStart(&ctx->timer, 5000);
-                break;
+                file_download_range_t *range = &ctx->range[i];
+
+                /* Failed ranges go again once the retry back-off expired */
+                if (range->state == RANGE_STATE_FAILED)
+                {
+                    if (MultiTimerActivated(&ctx->timer))
+                    {
+                        continue;
+                    }
+                    if (file_download_range_request(ctx, range) != OPRT_OK)
+                    {
+                        break;
+                    }
+                    continue;
+                }
+
+                /* Keep the window full */
+                if (range->state != RANGE_STATE_FREE || ctx->request_offset >= ctx->file_size)
+                {
+                    continue;
+                }
+                range->offset = ctx->request_offset;
+                range->length = (ctx->file_size - ctx->request_offset) > ctx->range_length ? (ctx->range_length) : (ctx->file_size - ctx->request_offset);
+                range->retry = 0;
+                ctx->request_offset += range->length;
+                if (file_download_range_request(ctx, range) != OPRT_OK)
+                {
+                    break;
+                }
             }
 
             return DL_STATUS_EAGAIN;
@@ -244,6 +621,27 @@ int file_download_yield(file_download_context_t *ctx)
 
 int file_download_free(file_download_context_t *ctx)
 {
-    system_free(ctx->config.url);
+    int i;
+    MultiTimerStop(&ctx->timer);
+    for (i = 0; i < FILE_DOWNLOAD_WINDOW_MAX; i++)
+    {
+        if (ctx->range[i].buffer)
+        {
+            system_free(ctx->range[i].buffer);
+            ctx->range[i].buffer = NULL;
+            ctx->range[i].buffer_size = 0;
+        }
+    }
+    file_download_https_close(ctx);
+    if (ctx->config.https_url)
+    {
+        system_free(ctx->config.https_url);
+        ctx->config.https_url = NULL;
+    }
+    if (ctx->config.url)
+    {
+        system_free(ctx->config.url);
+        ctx->config.url = NULL;
+    }
     return OPRT_OK;
 }
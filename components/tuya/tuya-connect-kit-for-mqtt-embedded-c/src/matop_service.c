@@ -196,27 +196,45 @@ int matop_serice_init(matop_context_t *context, const matop_config_t *config)
     int ret;
     char topic_buffer[48];
 
+    /* Re-init on reconnect: answers to pending requests are lost with the old
+     * connection, ids keep counting so a late answer can't match a new request */
+    mqtt_atop_message_t *pending = context->message_list;
+    uint32_t id_cnt = context->id_cnt;
+
     memset(context, 0, sizeof(matop_context_t));
     context->config = *config;
+    context->id_cnt = id_cnt;
+    sprintf(context->resquest_topic, "rpc/req/%s", config->devid);
 
     sprintf(topic_buffer, "rpc/rsp/%s", config->devid);
     ret = tuya_mqtt_subscribe_message_callback_register(context->config.mqctx, topic_buffer, on_matop_service_data_receive, context);
     if (ret != OPRT_OK)
     {
         TY_LOGE("Topic subscribe error:%s", topic_buffer);
-        return ret;
     }
-
-    sprintf(topic_buffer, "rpc/file/%s", config->devid);
-    tuya_mqtt_subscribe_message_callback_register(context->config.mqctx, topic_buffer, on_matop_service_file_rawdata_receive, context);
-    if (ret != OPRT_OK)
+    else
     {
-        TY_LOGE("Topic subscribe error:%s", topic_buffer);
-        return ret;
+        sprintf(topic_buffer, "rpc/file/%s", config->devid);
+        ret = tuya_mqtt_subscribe_message_callback_register(context->config.mqctx, topic_buffer, on_matop_service_file_rawdata_receive, context);
+        if (ret != OPRT_OK)
+        {
+            TY_LOGE("Topic subscribe error:%s", topic_buffer);
+        }
     }
 
-    sprintf(context->resquest_topic, "rpc/req/%s", config->devid);
-    return OPRT_OK;
+    /* Fail them, so their owners retry on the new connection */
+    while (pending)
+    {
+        mqtt_atop_message_t *entry = pending;
+        pending = entry->next;
+        TY_LOGW("Message id %d dropped.", entry->id);
+        if (entry->notify_cb)
+        {
+            entry->notify_cb(&(atop_base_response_t){.success = false}, entry->user_data);
+        }
+        system_free(entry);
+    }
+    return ret;
 }
 
 int matop_serice_yield(matop_context_t *context)
@@ -116,6 +116,8 @@ int mqtt_bind_token_get(const tuya_iot_config_t* config, tuya_binding_info_t* bi
         case STATE_MQTT_BIND_TOKEN_WAIT:
             tuya_mqtt_loop(&mqctx);
             if (strlen(binding->token) == 0) {
+                /* tuya_mqtt_loop does not block, sleep until the socket has data */
+                tuya_mqtt_wait(&mqctx, MQTT_RECV_BLOCK_TIME_MS);
                 break;
             }
             mqtt_bind_state = STATE_MQTT_BIND_COMPLETE;
@@ -8,8 +8,11 @@
 #include "tuya_error_code.h"
 #include "system_interface.h"
 #include "mqtt_client_interface.h"
+#include "network_interface.h"
 
 #include "cJSON.h"
+#include "cjson_arena.h"
+#include "core_json.h"
 #include "crc32.h"
 #include "uni_md5.h"
 #include "aes_inf.h"
@@ -26,17 +29,17 @@
 #define PV22_SOURCE_OFFSET (PV22_SEQUENCE_OFFSET + PV22_SEQUENCE_LENGTH)
 #define PV22_FIXED_HEADER_LENGTH (15)
 
-#define MQTT_REPORT_FMT "{\"protocol\":%d,\"t\":%ld,\"data\":%s}"
 #define MQTT_FMT_MAX (64)
 
 static void on_subscribe_message_default(uint16_t msgid, const mqtt_client_message_t *msg, void *userdata);
 
+/* The data points into the packet buffer, right after the fixed header. */
 typedef struct
 {
 	uint32_t sequence;
 	uint32_t source;
 	size_t datalen;
-	uint8_t data[0];
+	uint8_t *data;
 } pv22_packet_object_t;
 
 static int tuya_mqtt_signature_tool(const tuya_meta_info_t *input, tuya_mqtt_access_t *signout)
@@ -95,21 +98,24 @@ static int tuya_mqtt_signature_tool(const tuya_meta_info_t *input, tuya_mqtt_acc
 /* -------------------------------------------------------------------------- */
 /*                              PV22 packet parse                             */
 /* -------------------------------------------------------------------------- */
-static int pv22_packet_encode(const uint8_t *key, const pv22_packet_object_t *input, uint8_t *output, size_t *olen)
+static int pv22_packet_encode(const AES128_KEY_CTX_S *key, const pv22_packet_object_t *input, uint8_t *output, size_t *olen)
 {
 	int rt = OPRT_OK;
 
+	/* plaintext must already sit behind the header with room for the padding */
+	if (input->data != output + PV22_FIXED_HEADER_LENGTH || input->datalen == 0)
+	{
+		return OPRT_INVALID_PARM;
+	}
+
 	// data
-	uint32_t encrypt_len = 0;
-	uint8_t *encrypt_data;
-	rt = aes128_ecb_encode((const uint8_t *)input->data, input->datalen, &encrypt_data, (unsigned int *)&encrypt_len, key);
+	uint32_t encrypt_len = aes_pkcs7padding_buffer(input->data, input->datalen);
+	rt = aes128_ecb_encode_raw_ctx(input->data, encrypt_len, input->data, key);
 	if (OPRT_OK != rt)
 	{
 		TY_LOGE("encrypt fail:%d", rt);
 		return OPRT_COM_ERROR;
 	}
-	memcpy(output + PV22_FIXED_HEADER_LENGTH, encrypt_data, encrypt_len);
-	system_free(encrypt_data);
 
 	// verison
 	memcpy(output, "2.2", PV22_VER_LENGTH);
@@ -132,7 +138,7 @@ static int pv22_packet_encode(const uint8_t *key, const pv22_packet_object_t *in
 	return OPRT_OK;
 }
 
-static int pv22_packet_decode(const uint8_t *key, const uint8_t *input, size_t ilen, pv22_packet_object_t *output)
+static int pv22_packet_decode(const AES128_KEY_CTX_S *key, uint8_t *input, size_t ilen, pv22_packet_object_t *output)
 {
 	/* package length check */
 	if (ilen < PV22_FIXED_HEADER_LENGTH)
@@ -162,22 +168,42 @@ static int pv22_packet_decode(const uint8_t *key, const uint8_t *input, size_t i
 	output->source = source;
 
 	/* get encrypt data */
-	uint8_t *data = (uint8_t *)input + PV22_FIXED_HEADER_LENGTH;
+	uint8_t *data = input + PV22_FIXED_HEADER_LENGTH;
 	size_t data_len = (size_t)(ilen - PV22_FIXED_HEADER_LENGTH);
 	TY_LOGD("crc32:%08x, sequence:%ld, source:%ld, datalen:%zu", (unsigned int)crc32, sequence, source, data_len);
 
-	// decrypt buffer
-	uint8_t *decrypt_data;
-	size_t decrypt_len = 0;
-	int rt = aes128_ecb_decode((const uint8_t *)data, data_len, &decrypt_data, (unsigned int *)&decrypt_len, key);
+	if (data_len == 0 || data_len % AES128_ENCRYPT_KEY_LEN != 0)
+	{
+		TY_LOGE("encrypt data len error:%zu", data_len);
+		return OPRT_COM_ERROR;
+	}
+
+	/* decrypt in place, ECB blocks are independent */
+	int rt = aes128_ecb_decode_raw_ctx(data, data_len, data, key);
 	if (OPRT_OK != rt)
 	{
 		TY_LOGE("mqtt data decrypt fail:%d", rt);
 		return OPRT_COM_ERROR;
 	}
-	memcpy(output->data, decrypt_data, decrypt_len);
-	output->datalen = decrypt_len;
-	system_free(decrypt_data);
+
+	/* PKCS7 unpadding, every padding byte holds the padding length */
+	uint8_t padding = data[data_len - 1];
+	bool valid = padding != 0 && padding <= AES128_ENCRYPT_KEY_LEN;
+	size_t i;
+	for (i = 2; valid && i <= padding; i++)
+	{
+		valid = data[data_len - i] == padding;
+	}
+	if (!valid)
+	{
+		TY_LOGE("padding error:%d", padding);
+		return OPRT_COM_ERROR;
+	}
+
+	/* at least one padding byte was stripped, so the terminator stays inside the ciphertext span */
+	output->data = data;
+	output->datalen = data_len - padding;
+	output->data[output->datalen] = '\0';
 
 	return OPRT_OK;
 }
@@ -300,31 +326,57 @@ static void mqtt_subscribe_message_distribute(tuya_mqtt_context_t *context, uint
 /* -------------------------------------------------------------------------- */
 /*                       Tuya internal subscribe message                      */
 /* -------------------------------------------------------------------------- */
-static int tuya_protocol_message_parse_process(tuya_mqtt_context_t *context, const uint8_t *payload, size_t payload_len)
+/* Index of the first handler of protocol_id, or count */
+static size_t tuya_protocol_handle_find(const tuya_protocol_handle_t *handles, size_t count, int protocol_id)
 {
-	int ret = OPRT_OK;
+	size_t low = 0;
+	size_t high = count;
+	while (low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+		if (handles[mid].id < protocol_id)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return low;
+}
 
-	pv22_packet_object_t *packet = system_malloc(payload_len);
-	if (!packet)
+static void tuya_protocol_handle_scan(const tuya_protocol_handle_t *handles, size_t count, int protocol_id,
+									  bool *tree, bool *raw)
+{
+	size_t i = tuya_protocol_handle_find(handles, count, protocol_id);
+	for (; i < count && handles[i].id == protocol_id; i++)
 	{
-		TY_LOGE("packet malloc fail.");
-		return OPRT_MALLOC_FAILED;
+		*raw |= handles[i].raw;
+		*tree |= !handles[i].raw;
 	}
+}
 
-	ret = pv22_packet_decode((const uint8_t *)context->signature.cipherkey, payload, payload_len, packet);
-	if (ret != OPRT_OK)
+static void tuya_protocol_handle_call(const tuya_protocol_handle_t *handles, size_t count, int protocol_id,
+									  bool raw, void *user_data, tuya_protocol_event_t *event)
+{
+	size_t i = tuya_protocol_handle_find(handles, count, protocol_id);
+	for (; i < count && handles[i].id == protocol_id; i++)
 	{
-		TY_LOGE("packet decode fail.");
-		system_free(packet);
-		return OPRT_COM_ERROR;
+		if (handles[i].raw == raw)
+		{
+			event->user_data = handles[i].user_data ? handles[i].user_data : user_data;
+			handles[i].cb(event);
+		}
 	}
-	TY_LOGV("Data JSON:%.*s", packet->datalen, packet->data);
+}
 
+static int tuya_protocol_message_dispatch(tuya_mqtt_context_t *context, const char *data)
+{
 	/* json parse */
 	cJSON *root = NULL;
 	cJSON *json = NULL;
-	root = cJSON_Parse((const char *)packet->data);
-	system_free(packet);
+	root = cJSON_Parse(data);
 	if (NULL == root)
 	{
 		TY_LOGE("JSON parse error");
@@ -357,26 +409,88 @@ static int tuya_protocol_message_parse_process(tuya_mqtt_context_t *context, con
 	event.root_json = root;
 	event.data = cJSON_GetObjectItem(root, "data");
 
+	tuya_protocol_handle_call(context->protocol_table, context->protocol_table_count, protocol_id,
+							  false, context->user_data, &event);
 	/* LOCK */
-	tuya_protocol_handle_t *target = context->protocol_list;
-	for (; target; target = target->next)
+	tuya_protocol_handle_call(context->protocol_list, context->protocol_count, protocol_id,
+							  false, NULL, &event);
+	/* UNLOCK */
+
+	cJSON_Delete(root);
+	return OPRT_OK;
+}
+
+static int tuya_protocol_message_raw_dispatch(tuya_mqtt_context_t *context, uint16_t protocol_id, char *data, size_t len)
+{
+	tuya_protocol_event_t event = {0};
+	if (JSON_Search(data, len, "data", sizeof("data") - 1, &event.raw_data, &event.raw_length) != JSONSuccess)
 	{
-		if (target->id == protocol_id)
-		{
-			event.user_data = target->user_data,
-			target->cb(&event);
-		}
+		TY_LOGE("get json err");
+		return OPRT_CJSON_GET_ERR;
 	}
+	event.event_id = protocol_id;
+
+	tuya_protocol_handle_call(context->protocol_table, context->protocol_table_count, protocol_id,
+							  true, context->user_data, &event);
+	/* LOCK */
+	tuya_protocol_handle_call(context->protocol_list, context->protocol_count, protocol_id,
+							  true, NULL, &event);
 	/* UNLOCK */
 
-	cJSON_Delete(root);
 	return OPRT_OK;
 }
 
+static int tuya_protocol_message_parse_process(tuya_mqtt_context_t *context, uint8_t *payload, size_t payload_len)
+{
+	int ret = OPRT_OK;
+	pv22_packet_object_t packet;
+
+	ret = pv22_packet_decode(&context->cipher, payload, payload_len, &packet);
+	if (ret != OPRT_OK)
+	{
+		TY_LOGE("packet decode fail.");
+		return OPRT_COM_ERROR;
+	}
+	TY_LOGV("Data JSON:%.*s", packet.datalen, packet.data);
+
+	/* Find out who wants the message before paying for a cJSON tree */
+	char *value;
+	size_t value_length;
+	int protocol_id = -1;
+	if (JSON_Search((char *)packet.data, packet.datalen, "protocol", sizeof("protocol") - 1,
+					&value, &value_length) == JSONSuccess)
+	{
+		protocol_id = (int)strtol(value, NULL, 10);
+	}
+
+	bool tree = protocol_id < 0;
+	bool raw = false;
+	tuya_protocol_handle_scan(context->protocol_table, context->protocol_table_count, protocol_id, &tree, &raw);
+	tuya_protocol_handle_scan(context->protocol_list, context->protocol_count, protocol_id, &tree, &raw);
+
+	/* The message tree and whatever the handlers build from it live in the arena */
+	if (tree)
+	{
+		cjson_arena_begin();
+		ret = tuya_protocol_message_dispatch(context, (const char *)packet.data);
+		cjson_arena_end();
+	}
+
+	/* Last, raw handlers may change the text in place */
+	if (raw)
+	{
+		ret = tuya_protocol_message_raw_dispatch(context, protocol_id, (char *)packet.data, packet.datalen);
+	}
+	return ret;
+}
+
 static void on_subscribe_message_default(uint16_t msgid, const mqtt_client_message_t *msg, void *userdata)
 {
 	tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
-	int ret = tuya_protocol_message_parse_process(context, msg->payload, msg->length);
+
+	/* The payload points into the MQTT client receive buffer, which stays
+	 * writable until this callback returns, so it is decrypted in place. */
+	int ret = tuya_protocol_message_parse_process(context, (uint8_t *)msg->payload, msg->length);
 	if (ret != OPRT_OK)
 	{
 		TY_LOGE("protocol message parse error:%d", ret);
@@ -439,8 +553,7 @@ static void mqtt_client_puback_cb(void *client, uint16_t msgid, void *userdata)
 	tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
 	TY_LOGD("PUBACK ID:%d", msgid);
 
-	/* LOCK */
-	/* publish async process */
+	/* publish_list belongs to the loop task, other tasks go through publish_queue */
 	mqtt_publish_handle_t **next_handle = &context->publish_list;
 	for (; *next_handle; next_handle = &(*next_handle)->next)
 	{
@@ -449,12 +562,10 @@ static void mqtt_client_puback_cb(void *client, uint16_t msgid, void *userdata)
 		{
 			entry->cb(OPRT_OK, entry->user_data);
 			*next_handle = entry->next;
-			system_free(entry->payload);
 			system_free(entry);
 			break;
 		}
 	}
-	/* UNLOCK */
 }
 
 /* -------------------------------------------------------------------------- */
@@ -465,11 +576,23 @@ int tuya_mqtt_init(tuya_mqtt_context_t *context, const tuya_mqtt_config_t *confi
 	int rt = OPRT_OK;
 	mqtt_client_status_t mqtt_status;
 
+	/* Dispatch looks handlers up by binary search */
+	for (size_t i = 1; i < config->protocol_count; i++)
+	{
+		if (config->protocols[i].id < config->protocols[i - 1].id)
+		{
+			TY_LOGE("protocol table not sorted");
+			return OPRT_INVALID_PARM;
+		}
+	}
+
 	/* Clean to zero */
 	memset(context, 0, sizeof(tuya_mqtt_context_t));
 
 	/* configuration */
 	context->user_data = config->user_data;
+	context->protocol_table = config->protocols;
+	context->protocol_table_count = config->protocol_count;
 	context->on_unbind = config->on_unbind;
 	context->on_connected = config->on_connected;
 	context->on_disconnect = config->on_disconnect;
@@ -490,6 +613,16 @@ int tuya_mqtt_init(tuya_mqtt_context_t *context, const tuya_mqtt_config_t *confi
 		return rt;
 	}
 
+	/* Expand the cipher key once, it is used for every PV22 packet */
+	aes128_key_ctx_init(&context->cipher, (const uint8_t *)context->signature.cipherkey);
+
+	rt = mpsc_ring_init(&context->publish_queue, MQTT_PUBLISH_QUEUE_LENGTH);
+	if (OPRT_OK != rt)
+	{
+		TY_LOGE("publish queue init error:%d", rt);
+		return rt;
+	}
+
 	/* MQTT Client object new */
 	context->mqtt_client = mqtt_client_new();
 	if (context->mqtt_client == NULL)
@@ -601,7 +734,8 @@ int tuya_mqtt_stop(tuya_mqtt_context_t *context)
 	return OPRT_OK;
 }
 
-int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb, void *user_data)
+static int tuya_mqtt_protocol_register_common(tuya_mqtt_context_t *context, uint16_t protocol_id,
+											  tuya_protocol_callback_t cb, void *user_data, bool raw)
 {
 	if (context == NULL || context->is_inited == false || cb == NULL)
 	{
@@ -610,31 +744,58 @@ int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_
 
 	/* LOCK */
 	/* Repetition filter */
-	tuya_protocol_handle_t *target = context->protocol_list;
-	while (target)
+	size_t end = tuya_protocol_handle_find(context->protocol_list, context->protocol_count, protocol_id);
+	for (; end < context->protocol_count && context->protocol_list[end].id == protocol_id; end++)
 	{
-		if (target->id == protocol_id && target->cb == cb)
+		if (context->protocol_list[end].cb == cb)
 		{
 			return OPRT_COM_ERROR;
 		}
-		target = target->next;
 	}
 
-	tuya_protocol_handle_t *new_handle = system_calloc(1, sizeof(tuya_protocol_handle_t));
-	if (!new_handle)
+	if (context->protocol_count == context->protocol_capacity)
 	{
-		return OPRT_MALLOC_FAILED;
+		size_t capacity = context->protocol_capacity ? context->protocol_capacity * 2 : 4;
+		tuya_protocol_handle_t *list = system_malloc(capacity * sizeof(tuya_protocol_handle_t));
+		if (!list)
+		{
+			return OPRT_MALLOC_FAILED;
+		}
+		if (context->protocol_count)
+		{
+			memcpy(list, context->protocol_list, context->protocol_count * sizeof(tuya_protocol_handle_t));
+		}
+		system_free(context->protocol_list);
+		context->protocol_list = list;
+		context->protocol_capacity = capacity;
 	}
-	new_handle->id = protocol_id;
-	new_handle->cb = cb;
-	new_handle->user_data = user_data;
-	new_handle->next = context->protocol_list;
-	context->protocol_list = new_handle;
+
+	/* Behind the handlers already registered for the id. Tree and raw handlers each run in
+	 * registration order, all tree handlers of a message before its raw handlers */
+	memmove(&context->protocol_list[end + 1], &context->protocol_list[end],
+			(context->protocol_count - end) * sizeof(tuya_protocol_handle_t));
+	context->protocol_list[end] = (tuya_protocol_handle_t){
+		.id = protocol_id,
+		.raw = raw,
+		.cb = cb,
+		.user_data = user_data,
+	};
+	context->protocol_count++;
 	/* UNLOCK */
 
 	return OPRT_OK;
 }
 
+int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb, void *user_data)
+{
+	return tuya_mqtt_protocol_register_common(context, protocol_id, cb, user_data, false);
+}
+
+int tuya_mqtt_protocol_register_raw(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb, void *user_data)
+{
+	return tuya_mqtt_protocol_register_common(context, protocol_id, cb, user_data, true);
+}
+
 int tuya_mqtt_protocol_unregister(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb)
 {
 	if (context == NULL || context->is_inited == false || cb == NULL)
@@ -644,18 +805,15 @@ int tuya_mqtt_protocol_unregister(tuya_mqtt_context_t *context, uint16_t protoco
 
 	/* LOCK */
 	/* Remove object form list */
-	tuya_protocol_handle_t **target = &context->protocol_list;
-	while (*target)
+	size_t i = tuya_protocol_handle_find(context->protocol_list, context->protocol_count, protocol_id);
+	for (; i < context->protocol_count && context->protocol_list[i].id == protocol_id; i++)
 	{
-		tuya_protocol_handle_t *entry = *target;
-		if (entry->id == protocol_id && entry->cb == cb)
-		{
-			*target = entry->next;
-			system_free(entry);
-		}
-		else
+		if (context->protocol_list[i].cb == cb)
 		{
-			target = &entry->next;
+			context->protocol_count--;
+			memmove(&context->protocol_list[i], &context->protocol_list[i + 1],
+					(context->protocol_count - i) * sizeof(tuya_protocol_handle_t));
+			break;
 		}
 	}
 	/* UNLOCK */
@@ -663,130 +821,232 @@ int tuya_mqtt_protocol_unregister(tuya_mqtt_context_t *context, uint16_t protoco
 	return OPRT_OK;
 }
 
-int tuya_mqtt_client_publish_common(tuya_mqtt_context_t *context, const char *topic,
-									const uint8_t *payload, size_t payload_length,
-									mqtt_publish_notify_cb_t cb, void *user_data,
-									int timeout_ms, bool async)
+/* The handle, its payload and a copy of the topic share one allocation, freed with the handle.
+ * The loop task sends it later, when the caller's topic may be gone. */
+static mqtt_publish_handle_t *mqtt_publish_handle_new(const char *topic, size_t payload_length)
 {
-	if (context == NULL || topic == NULL || payload == NULL || (cb == NULL && async == true))
+	size_t topic_size = strlen(topic) + 1;
+	mqtt_publish_handle_t *handle = system_malloc(sizeof(mqtt_publish_handle_t) + payload_length + topic_size);
+	if (handle == NULL)
 	{
-		return OPRT_INVALID_PARM;
-	}
-
-	if (cb == NULL)
-	{
-		uint16_t msgid = mqtt_client_publish(context->mqtt_client, topic,
-											 payload, payload_length, MQTT_QOS_0);
-		if (msgid <= 0)
-		{
-			return OPRT_COM_ERROR;
-		}
-		return OPRT_OK;
+		return NULL;
 	}
+	memset(handle, 0, sizeof(mqtt_publish_handle_t));
+	handle->payload = (uint8_t *)(handle + 1);
+	handle->payload_length = payload_length;
+	handle->topic = (char *)handle->payload + payload_length;
+	memcpy(handle->topic, topic, topic_size);
+	return handle;
+}
 
-	mqtt_publish_handle_t *handle = system_malloc(sizeof(mqtt_publish_handle_t));
-	TUYA_CHECK_NULL_RETURN(handle, OPRT_MALLOC_FAILED);
+/* Takes ownership of the handle and queues it for the loop task, which owns the MQTT client. */
+static int mqtt_publish_handle_submit(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle,
+									  mqtt_publish_notify_cb_t cb, void *user_data, int timeout_ms)
+{
 	handle->next = NULL;
 	handle->msgid = 0;
-	handle->topic = (char *)topic;
 	handle->timeout = system_timestamp() + timeout_ms;
 	handle->cb = cb;
 	handle->user_data = user_data;
-	handle->payload_length = payload_length;
-	handle->payload = system_malloc(payload_length);
-	if (handle->payload == NULL)
+
+	if (mpsc_ring_push(&context->publish_queue, handle) != OPRT_OK)
 	{
-		return OPRT_MALLOC_FAILED;
+		TY_LOGW("publish queue full");
+		system_free(handle);
+		return OPRT_EXCEED_UPPER_LIMIT;
 	}
-	memcpy(handle->payload, payload, payload_length);
 
-	if (async == false)
+	/* The loop may be asleep in tuya_mqtt_wait */
+	network_wakeup();
+	return OPRT_OK;
+}
+
+/* Encrypted in the order the loop drains the queue, so sequence numbers stay in send order. */
+static int mqtt_publish_handle_encrypt(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+	pv22_packet_object_t packet;
+	packet.data = handle->payload + PV22_FIXED_HEADER_LENGTH;
+	packet.datalen = handle->payload_length;
+	packet.sequence = context->sequence_out++;
+	packet.source = 1;
+
+	int ret = pv22_packet_encode(&context->cipher, &packet, handle->payload, &handle->payload_length);
+	if (ret != OPRT_OK)
 	{
-		handle->msgid = mqtt_client_publish(context->mqtt_client, handle->topic,
-											handle->payload, handle->payload_length,
-											MQTT_QOS_1);
+		TY_LOGE("pv22_packet_encode error: %d", ret);
+		return OPRT_COM_ERROR;
 	}
+	handle->encrypt = false;
+	return OPRT_OK;
+}
 
-	if (context->publish_list == NULL)
+/* Moves queued publishes onto publish_list, at most one queue length per pass
+ * so tasks refilling the queue can not keep the loop from receiving. */
+static void mqtt_publish_queue_drain(tuya_mqtt_context_t *context)
+{
+	mqtt_publish_handle_t **tail = &context->publish_list;
+	while (*tail)
 	{
-		context->publish_list = handle;
-		return OPRT_OK;
+		tail = &(*tail)->next;
+	}
+
+	uint32_t count;
+	for (count = 0; count < MQTT_PUBLISH_QUEUE_LENGTH; count++)
+	{
+		mqtt_publish_handle_t *handle = mpsc_ring_pop(&context->publish_queue);
+		if (handle == NULL)
+		{
+			break;
+		}
+
+		if (handle->encrypt && mqtt_publish_handle_encrypt(context, handle) != OPRT_OK)
+		{
+			if (handle->cb)
+			{
+				handle->cb(OPRT_COM_ERROR, handle->user_data);
+			}
+			system_free(handle);
+			continue;
+		}
+
+		/* QoS0, sent and freed at once */
+		if (handle->cb == NULL)
+		{
+			mqtt_client_publish(context->mqtt_client, handle->topic,
+								handle->payload, handle->payload_length, MQTT_QOS_0);
+			system_free(handle);
+			continue;
+		}
+
+		/* QoS1, published below and kept until PUBACK */
+		*tail = handle;
+		tail = &handle->next;
 	}
+}
 
-	mqtt_publish_handle_t *last = context->publish_list;
-	while (last->next != NULL)
+int tuya_mqtt_client_publish_common(tuya_mqtt_context_t *context, const char *topic,
+									const uint8_t *payload, size_t payload_length,
+									mqtt_publish_notify_cb_t cb, void *user_data,
+									int timeout_ms)
+{
+	if (context == NULL || topic == NULL || payload == NULL)
 	{
-		last = last->next;
+		return OPRT_INVALID_PARM;
 	}
-	last->next = handle;
 
-	return OPRT_OK;
+	mqtt_publish_handle_t *handle = mqtt_publish_handle_new(topic, payload_length);
+	TUYA_CHECK_NULL_RETURN(handle, OPRT_MALLOC_FAILED);
+	memcpy(handle->payload, payload, payload_length);
+
+	return mqtt_publish_handle_submit(context, handle, cb, user_data, timeout_ms);
 }
 
-int tuya_mqtt_protocol_data_publish_with_topic_common(tuya_mqtt_context_t *context, const char *topic,
-													  uint16_t protocol_id, const uint8_t *data, uint16_t length,
-													  mqtt_publish_notify_cb_t cb, void *user_data,
-													  int timeout_ms, bool async)
+static int tuya_mqtt_protocol_data_write_with_topic_common(tuya_mqtt_context_t *context, const char *topic,
+															uint16_t protocol_id, size_t length,
+															tuya_mqtt_data_writer_t writer, void *writer_data,
+															mqtt_publish_notify_cb_t cb, void *user_data,
+															int timeout_ms)
 {
 	if (context == NULL || context->is_inited == false)
 	{
 		return OPRT_INVALID_PARM;
 	}
 
+	if (topic == NULL || writer == NULL)
+	{
+		return OPRT_INVALID_PARM;
+	}
+
 	if (context->is_connected == false)
 	{
 		return OPRT_COM_ERROR;
 	}
 
-	int ret = OPRT_OK;
-
-	pv22_packet_object_t *packet = system_malloc(PV22_FIXED_HEADER_LENGTH + MQTT_FMT_MAX + length + 16);
-	if (!packet)
+	/* header + JSON envelope + padding, encrypted in place by the loop task */
+	mqtt_publish_handle_t *handle = mqtt_publish_handle_new(topic, PV22_FIXED_HEADER_LENGTH + MQTT_FMT_MAX + length + AES128_ENCRYPT_KEY_LEN);
+	if (NULL == handle)
 	{
 		TY_LOGE("packet malloc fail.");
 		return OPRT_MALLOC_FAILED;
 	}
 
-	size_t buffer_len = 0;
-	uint8_t *buffer = system_malloc(PV22_FIXED_HEADER_LENGTH + MQTT_FMT_MAX + length + 16);
-	if (NULL == buffer)
+	/* {"protocol":4,"t":1612324744,"data":{...}} written straight into the plaintext region */
+	json_writer_t json;
+	char *plaintext = (char *)handle->payload + PV22_FIXED_HEADER_LENGTH;
+	json_writer_init(&json, plaintext, MQTT_FMT_MAX + length);
+	json_writer_literal(&json, "{\"protocol\":");
+	json_writer_int(&json, protocol_id);
+	json_writer_literal(&json, ",\"t\":");
+	json_writer_int(&json, system_timestamp());
+	json_writer_literal(&json, ",\"data\":");
+	int rt = writer(&json, writer_data);
+	json_writer_raw(&json, "}", 1);
+
+	int printlen = json_writer_finish(&json);
+	if (rt != OPRT_OK || printlen < 0)
 	{
-		TY_LOGE("buffer malloc fail");
-		system_free(buffer);
-		return OPRT_MALLOC_FAILED;
+		TY_LOGE("report data write error:%d, limit %d bytes", rt, (int)length);
+		system_free(handle);
+		return rt != OPRT_OK ? rt : printlen;
+	}
+	handle->payload_length = printlen;
+	handle->encrypt = true;
+	TY_LOGD("Report data:%s", plaintext);
+
+	return mqtt_publish_handle_submit(context, handle, cb, user_data, timeout_ms);
+}
+
+int tuya_mqtt_protocol_data_write_common(tuya_mqtt_context_t *context, uint16_t protocol_id, size_t length,
+										 tuya_mqtt_data_writer_t writer, void *writer_data,
+										 mqtt_publish_notify_cb_t cb, void *user_data,
+										 int timeout_ms)
+{
+	if (context == NULL)
+	{
+		return OPRT_INVALID_PARM;
 	}
+	return tuya_mqtt_protocol_data_write_with_topic_common(context, context->signature.topic_out,
+														   protocol_id, length, writer, writer_data,
+														   cb, user_data, timeout_ms);
+}
 
-	packet->datalen = sprintf((char *)packet->data, MQTT_REPORT_FMT, protocol_id, system_timestamp(), (char *)data);
-	packet->sequence = context->sequence_out++;
-	packet->source = 1;
-	TY_LOGD("Report data:%s", (char *)packet->data);
+typedef struct
+{
+	const uint8_t *data;
+	uint16_t length;
+} mqtt_raw_data_t;
 
-	ret = pv22_packet_encode((const uint8_t *)context->signature.cipherkey,
-							 (const pv22_packet_object_t *)packet, buffer, &buffer_len);
-	system_free(packet);
-	if (ret != OPRT_OK)
+static int mqtt_raw_data_write(json_writer_t *writer, void *user_data)
+{
+	const mqtt_raw_data_t *raw = (const mqtt_raw_data_t *)user_data;
+	json_writer_raw(writer, (const char *)raw->data, raw->length);
+	return OPRT_OK;
+}
+
+int tuya_mqtt_protocol_data_publish_with_topic_common(tuya_mqtt_context_t *context, const char *topic,
+													  uint16_t protocol_id, const uint8_t *data, uint16_t length,
+													  mqtt_publish_notify_cb_t cb, void *user_data,
+													  int timeout_ms)
+{
+	if (data == NULL)
 	{
-		TY_LOGE("pv22_packet_encode error: %d", ret);
-		system_free(buffer);
-		return OPRT_COM_ERROR;
+		return OPRT_INVALID_PARM;
 	}
 
-	/* mqtt client publish */
-	ret = tuya_mqtt_client_publish_common(context, (const char *)topic,
-										  (const uint8_t *)buffer, buffer_len,
-										  cb, user_data, timeout_ms, async);
-	system_free(buffer);
-	return ret;
+	mqtt_raw_data_t raw = {.data = data, .length = length};
+	return tuya_mqtt_protocol_data_write_with_topic_common(context, topic, protocol_id, length,
+														   mqtt_raw_data_write, &raw,
+														   cb, user_data, timeout_ms);
 }
 
 int tuya_mqtt_protocol_data_publish_common(tuya_mqtt_context_t *context, uint16_t protocol_id,
 										   const uint8_t *data, uint16_t length,
 										   mqtt_publish_notify_cb_t cb, void *user_data,
-										   int timeout_ms, bool async)
+										   int timeout_ms)
 {
 	return tuya_mqtt_protocol_data_publish_with_topic_common(context, context->signature.topic_out,
 															 protocol_id, data, length,
-															 cb, user_data, timeout_ms, async);
+															 cb, user_data, timeout_ms);
 }
 
 int tuya_mqtt_protocol_data_publish_with_topic(tuya_mqtt_context_t *context, const char *topic,
@@ -794,7 +1054,7 @@ int tuya_mqtt_protocol_data_publish_with_topic(tuya_mqtt_context_t *context, con
 {
 	return tuya_mqtt_protocol_data_publish_with_topic_common(context, topic,
 															 protocol_id, data, length,
-															 NULL, NULL, 0, false);
+															 NULL, NULL, 0);
 }
 
 int tuya_mqtt_protocol_data_publish(tuya_mqtt_context_t *context, uint16_t protocol_id, const uint8_t *data, uint16_t length)
@@ -846,10 +1106,11 @@ int tuya_mqtt_loop(tuya_mqtt_context_t *context)
 		return rt;
 	}
 
-	/* LOCK */
 	/* publish async process */
+	mqtt_publish_queue_drain(context);
+
 	mqtt_publish_handle_t **next_handle = &context->publish_list;
-	for (; *next_handle; next_handle = &(*next_handle)->next)
+	while (*next_handle)
 	{
 		mqtt_publish_handle_t *entry = *next_handle;
 
@@ -857,7 +1118,6 @@ int tuya_mqtt_loop(tuya_mqtt_context_t *context)
 		{
 			entry->cb(OPRT_TIMEOUT, entry->user_data);
 			*next_handle = entry->next;
-			system_free(entry->payload);
 			system_free(entry);
 			continue;
 		}
@@ -867,8 +1127,8 @@ int tuya_mqtt_loop(tuya_mqtt_context_t *context)
 			entry->msgid = mqtt_client_publish(context->mqtt_client, entry->topic,
 											   entry->payload, entry->payload_length, 1);
 		}
+		next_handle = &entry->next;
 	}
-	/* UNLOCK */
 
 	/* yield */
 	mqtt_client_yield(context->mqtt_client);
@@ -876,6 +1136,24 @@ int tuya_mqtt_loop(tuya_mqtt_context_t *context)
 	return rt;
 }
 
+int tuya_mqtt_wait(tuya_mqtt_context_t *context, uint32_t timeout_ms)
+{
+	if (context == NULL)
+	{
+		return OPRT_INVALID_PARM;
+	}
+
+	/* Without a connection only the wakeup can end the wait early */
+	if (context->is_inited == false || context->is_connected == false)
+	{
+		network_tls_wait(NULL, timeout_ms);
+		return OPRT_OK;
+	}
+
+	mqtt_client_wait(context->mqtt_client, timeout_ms);
+	return OPRT_OK;
+}
+
 int tuya_mqtt_destory(tuya_mqtt_context_t *context)
 {
 	if (context == NULL || context->is_inited != true)
@@ -885,6 +1163,30 @@ int tuya_mqtt_destory(tuya_mqtt_context_t *context)
 
 	mqtt_client_status_t mqtt_status = mqtt_client_deinit(context->mqtt_client);
 	mqtt_client_free(context->mqtt_client);
+	aes128_key_ctx_free(&context->cipher);
+
+	/* Publishes still queued or waiting for PUBACK fail, so their callers are not left waiting */
+	mqtt_publish_handle_t *handle;
+	while ((handle = context->publish_list) != NULL)
+	{
+		context->publish_list = handle->next;
+		handle->cb(OPRT_COM_ERROR, handle->user_data);
+		system_free(handle);
+	}
+	while ((handle = mpsc_ring_pop(&context->publish_queue)) != NULL)
+	{
+		if (handle->cb)
+		{
+			handle->cb(OPRT_COM_ERROR, handle->user_data);
+		}
+		system_free(handle);
+	}
+	mpsc_ring_free(&context->publish_queue);
+
+	system_free(context->protocol_list);
+	context->protocol_list = NULL;
+	context->protocol_count = 0;
+	context->protocol_capacity = 0;
 	if (mqtt_status != MQTT_STATUS_SUCCESS)
 	{
 		return OPRT_COM_ERROR;
@@ -902,6 +1204,23 @@ bool tuya_mqtt_connected(tuya_mqtt_context_t *context)
 	return context->is_connected;
 }
 
+typedef struct
+{
+	int channel;
+	int percent;
+} mqtt_upgrade_progress_t;
+
+static int mqtt_upgrade_progress_write(json_writer_t *writer, void *user_data)
+{
+	const mqtt_upgrade_progress_t *progress = (const mqtt_upgrade_progress_t *)user_data;
+	json_writer_literal(writer, "{\"progress\":\"");
+	json_writer_int(writer, progress->percent);
+	json_writer_literal(writer, "\",\"firmwareType\":");
+	json_writer_int(writer, progress->channel);
+	json_writer_raw(writer, "}", 1);
+	return OPRT_OK;
+}
+
 int tuya_mqtt_upgrade_progress_report(tuya_mqtt_context_t *context, int channel, int percent)
 {
 	if (percent > 100)
@@ -910,16 +1229,11 @@ int tuya_mqtt_upgrade_progress_report(tuya_mqtt_context_t *context, int channel,
 		return OPRT_INVALID_PARM;
 	}
 
-	uint8_t *data_buf = system_malloc(128);
-	if (NULL == data_buf)
-	{
-		return OPRT_MALLOC_FAILED;
-	}
-
-	int buffer_size = sprintf((char *)data_buf, "{\"progress\":\"%d\",\"firmwareType\":%d}", percent, channel);
-	uint16_t msgid = tuya_mqtt_protocol_data_publish(context, PRO_UPGE_PUSH, data_buf, (uint16_t)buffer_size);
-	system_free(data_buf);
-	if (msgid <= 0)
+	mqtt_upgrade_progress_t progress = {.channel = channel, .percent = percent};
+	int rt = tuya_mqtt_protocol_data_write_common(context, PRO_UPGE_PUSH, 64,
+												  mqtt_upgrade_progress_write, &progress,
+												  NULL, NULL, 0);
+	if (rt != OPRT_OK)
 	{
 		return OPRT_COM_ERROR;
 	}
@@ -0,0 +1,207 @@
+#include <stdint.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#include "tuya_log.h"
+#include "tuya_error_code.h"
+#include "system_interface.h"
+#include "ota_interface.h"
+#include "ota_delta.h"
+#include "crc32.h"
+
+typedef enum {
+    OTA_DELTA_STATE_HEADER,
+    OTA_DELTA_STATE_CONTROL,
+    OTA_DELTA_STATE_ADD,
+    OTA_DELTA_STATE_EXTRA,
+    OTA_DELTA_STATE_DONE,
+} ota_delta_state_t;
+
+static uint32_t ota_delta_u32(const uint8_t* p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* The patch only fits the exact image it was made from */
+static int ota_delta_source_check(ota_delta_t* delta, uint32_t source_crc)
+{
+    uint32_t crc = crc32_init();
+    size_t offset = 0;
+
+    while (offset < delta->source_size) {
+        size_t len = delta->source_size - offset;
+        len = len > OTA_DELTA_BUFFER_SIZE ? OTA_DELTA_BUFFER_SIZE : len;
+        if (ota_source_read(offset, delta->buffer, len) != OPRT_OK) {
+            TY_LOGE("source read error at %d", offset);
+            return OPRT_COM_ERROR;
+        }
+        crc = crc32_update(crc, delta->buffer, len);
+        offset += len;
+    }
+
+    if (crc32_final(crc) != source_crc) {
+        TY_LOGE("patch not made for the running image");
+        return OPRT_COM_ERROR;
+    }
+    return OPRT_OK;
+}
+
+static int ota_delta_header(ota_delta_t* delta)
+{
+    if (memcmp(delta->header, OTA_DELTA_MAGIC, 4) != 0) {
+        TY_LOGE("not a delta image");
+        return OPRT_INVALID_PARM;
+    }
+
+    delta->source_size = ota_delta_u32(delta->header + 4);
+    delta->image_size = ota_delta_u32(delta->header + 12);
+    TY_LOGI("delta image, source:%d, size:%d", delta->source_size, delta->image_size);
+
+    return ota_delta_source_check(delta, ota_delta_u32(delta->header + 8));
+}
+
+static int ota_delta_control(ota_delta_t* delta)
+{
+    delta->add_len = ota_delta_u32(delta->header);
+    delta->extra_len = ota_delta_u32(delta->header + 4);
+    delta->seek = (int32_t)ota_delta_u32(delta->header + 8);
+
+    if (delta->add_len > delta->image_size - delta->total ||
+        delta->extra_len > delta->image_size - delta->total - delta->add_len ||
+        delta->add_len > delta->source_size - delta->source_offset) {
+        TY_LOGE("bad patch block %" PRIu32 ",%" PRIu32, delta->add_len, delta->extra_len);
+        return OPRT_INVALID_PARM;
+    }
+    return OPRT_OK;
+}
+
+/* Move on once the add and extra parts of a block are both consumed */
+static int ota_delta_block_next(ota_delta_t* delta)
+{
+    if (delta->add_len) {
+        delta->state = OTA_DELTA_STATE_ADD;
+        return OPRT_OK;
+    }
+    if (delta->extra_len) {
+        delta->state = OTA_DELTA_STATE_EXTRA;
+        return OPRT_OK;
+    }
+
+    int64_t offset = (int64_t)delta->source_offset + delta->seek;
+    if (offset < 0 || offset > (int64_t)delta->source_size) {
+        TY_LOGE("bad patch seek %" PRId32, delta->seek);
+        return OPRT_INVALID_PARM;
+    }
+    delta->source_offset = offset;
+    delta->seek = 0;
+    delta->state = delta->total == delta->image_size ? OTA_DELTA_STATE_DONE : OTA_DELTA_STATE_CONTROL;
+    return OPRT_OK;
+}
+
+int ota_delta_init(ota_delta_t* delta, ota_delta_output_cb_t output_cb, void* user_data)
+{
+    memset(delta, 0, sizeof(ota_delta_t));
+    delta->buffer = system_malloc(OTA_DELTA_BUFFER_SIZE);
+    if (delta->buffer == NULL) {
+        return OPRT_MALLOC_FAILED;
+    }
+    delta->output_cb = output_cb;
+    delta->user_data = user_data;
+    delta->state = OTA_DELTA_STATE_HEADER;
+    return OPRT_OK;
+}
+
+int ota_delta_feed(ota_delta_t* delta, const uint8_t* data, size_t len)
+{
+    int rt = OPRT_OK;
+
+    if (delta == NULL || delta->buffer == NULL || (data == NULL && len)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    while (len > 0 && rt == OPRT_OK) {
+        switch (delta->state) {
+        case OTA_DELTA_STATE_HEADER:
+        case OTA_DELTA_STATE_CONTROL: {
+            size_t need = delta->state == OTA_DELTA_STATE_HEADER ? OTA_DELTA_HEADER_LEN : OTA_DELTA_CONTROL_LEN;
+            size_t copy = need - delta->fill;
+            copy = copy > len ? len : copy;
+            memcpy(delta->header + delta->fill, data, copy);
+            delta->fill += copy;
+            data += copy;
+            len -= copy;
+            if (delta->fill < need) {
+                break;
+            }
+
+            delta->fill = 0;
+            if (delta->state == OTA_DELTA_STATE_HEADER) {
+                rt = ota_delta_header(delta);
+                delta->state = delta->image_size ? OTA_DELTA_STATE_CONTROL : OTA_DELTA_STATE_DONE;
+            } else {
+                rt = ota_delta_control(delta);
+                if (rt == OPRT_OK) {
+                    rt = ota_delta_block_next(delta);
+                }
+            }
+            break;
+        }
+
+        case OTA_DELTA_STATE_ADD: {
+            /* Bounded by the buffer, the source is read as the patch arrives */
+            size_t n = delta->add_len;
+            n = n > len ? len : n;
+            n = n > OTA_DELTA_BUFFER_SIZE ? OTA_DELTA_BUFFER_SIZE : n;
+            rt = ota_source_read(delta->source_offset, delta->buffer, n);
+            if (rt != OPRT_OK) {
+                TY_LOGE("source read error at %d", delta->source_offset);
+                break;
+            }
+
+            size_t i;
+            for (i = 0; i < n; i++) {
+                delta->buffer[i] += data[i];
+            }
+            rt = delta->output_cb(delta->buffer, n, delta->user_data);
+            delta->source_offset += n;
+            delta->add_len -= n;
+            delta->total += n;
+            data += n;
+            len -= n;
+            if (rt == OPRT_OK && delta->add_len == 0) {
+                rt = ota_delta_block_next(delta);
+            }
+            break;
+        }
+
+        case OTA_DELTA_STATE_EXTRA: {
+            size_t n = delta->extra_len;
+            n = n > len ? len : n;
+            rt = delta->output_cb(data, n, delta->user_data);
+            delta->extra_len -= n;
+            delta->total += n;
+            data += n;
+            len -= n;
+            if (rt == OPRT_OK && delta->extra_len == 0) {
+                rt = ota_delta_block_next(delta);
+            }
+            break;
+        }
+
+        default:
+            TY_LOGE("data after the end of the patch");
+            rt = OPRT_INVALID_PARM;
+            break;
+        }
+    }
+
+    return rt;
+}
+
+void ota_delta_free(ota_delta_t* delta)
+{
+    if (delta->buffer) {
+        system_free(delta->buffer);
+        delta->buffer = NULL;
+    }
+}
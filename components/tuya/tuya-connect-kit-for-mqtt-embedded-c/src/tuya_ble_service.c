@@ -129,6 +129,8 @@ typedef struct
     uint8_t key_2[16];
     uint8_t register_key[16];
     uint8_t key_mask;
+    AES128_KEY_CTX_S key_1_ctx;
+    AES128_KEY_CTX_S key_2_ctx;
 
     MultiTimer timer_hdl;
     struct ble_msg_queue msg_queue;
@@ -364,12 +366,15 @@ static int ble_service_key_generation(uint8_t *iv)
     uint8_t in_data[48] = {0};
     uint8_t out_data[48] = {0};
     uint8_t key_iv[FRAME_IV_SIZE] = {0};
+    AES128_KEY_CTX_S auth_key_ctx;
+    TUYA_CALL_ERR_RETURN(aes128_key_ctx_init(&auth_key_ctx, sg_ble_service_params->auth_key));
     /* key1 plaintext */
     memcpy(in_data, sg_ble_service_params->auth_key, 32);
     memcpy(in_data + 32, iv, FRAME_IV_SIZE);
     /* key1 iv */
-    TUYA_CALL_ERR_RETURN(tal_aes128_cbc_encode_raw(in_data, 48, sg_ble_service_params->auth_key, key_iv, out_data));
+    TUYA_CALL_ERR_GOTO(aes128_cbc_encode_raw_ctx(in_data, 48, &auth_key_ctx, key_iv, out_data), __EXIT);
     memcpy(sg_ble_service_params->key_1, out_data + 32, 16);
+    TUYA_CALL_ERR_GOTO(aes128_key_ctx_init(&sg_ble_service_params->key_1_ctx, sg_ble_service_params->key_1), __EXIT);
     sg_ble_service_params->key_mask |= 0x02;
 
     /* set key2 */
@@ -378,12 +383,15 @@ static int ble_service_key_generation(uint8_t *iv)
     memcpy(md5_data, sg_ble_service_params->key_1, 16);
     memcpy(md5_data + 16, sg_ble_service_params->srand, 6);
     uni_md5_digest_tolal(md5_data, 22, sg_ble_service_params->key_2);
+    TUYA_CALL_ERR_GOTO(aes128_key_ctx_init(&sg_ble_service_params->key_2_ctx, sg_ble_service_params->key_2), __EXIT);
     sg_ble_service_params->key_mask |= 0x04;
 
     /* regist key */
     memcpy(key_iv, iv, 16);
-    tal_aes128_ecb_encode_raw(key_iv, 16, sg_ble_service_params->register_key, sg_ble_service_params->auth_key);
+    aes128_ecb_encode_raw_ctx(key_iv, 16, sg_ble_service_params->register_key, &auth_key_ctx);
 
+__EXIT:
+    aes128_key_ctx_free(&auth_key_ctx);
     return rt;
 }
 
@@ -481,7 +489,7 @@ static uint16_t get_crc_16(uint8_t *data, uint16_t size)
 static int ble_recv_data_decrypt(tuya_ble_pack_s *recv_pack, tuya_ble_frame_plain_s *recv_frame)
 {
     OPERATE_RET rt = OPRT_OK;
-    uint8_t *key = NULL;
+    const AES128_KEY_CTX_S *key = NULL;
     uint8_t iv[FRAME_IV_SIZE] = {0};
     uint32_t ciphertext_len = 0;
     uint32_t crc16_len = 0;
@@ -496,10 +504,10 @@ static int ble_recv_data_decrypt(tuya_ble_pack_s *recv_pack, tuya_ble_frame_plai
     switch (recv_pack->data->encrypt_mode)
     {
     case ENCRYPTION_MODE_KEY_1:
-        key = sg_ble_service_params->key_1;
+        key = &sg_ble_service_params->key_1_ctx;
         break;
     case ENCRYPTION_MODE_KEY_2:
-        key = sg_ble_service_params->key_2;
+        key = &sg_ble_service_params->key_2_ctx;
         break;
     default:
         return OPRT_COM_ERROR;
@@ -507,7 +515,7 @@ static int ble_recv_data_decrypt(tuya_ble_pack_s *recv_pack, tuya_ble_frame_plai
     memcpy(iv, recv_pack->data->iv, FRAME_IV_SIZE);
 
     ciphertext_len = recv_pack->frame_len - FRAME_ENCRYPT_MODE_SIZE - FRAME_IV_SIZE;
-    TUYA_CALL_ERR_RETURN(tal_aes128_cbc_decode_raw(recv_pack->data->ciphertext, ciphertext_len, key, iv, (uint8_t *)recv_frame));
+    TUYA_CALL_ERR_RETURN(aes128_cbc_decode_raw_ctx(recv_pack->data->ciphertext, ciphertext_len, key, iv, (uint8_t *)recv_frame));
 
     // check crc16
     crc16_len = UNI_HTONS(recv_frame->len);
@@ -641,7 +649,7 @@ static OPERATE_RET ble_service_get_device_info(const uint8_t *srand, const uint8
 static int ble_recv_cmd_process(tuya_ble_frame_plain_s *recv_frame, tuya_ble_frame_s **output, uint32_t *output_size)
 {
     OPERATE_RET rt = OPRT_OK;
-    uint8_t *key = NULL;
+    const AES128_KEY_CTX_S *key = NULL;
     uint8_t iv[FRAME_IV_SIZE] = {0};
     tuya_ble_frame_s *rsp_frame = NULL;
     uint8_t encrypt_mode = 0;
@@ -664,7 +672,7 @@ static int ble_recv_cmd_process(tuya_ble_frame_plain_s *recv_frame, tuya_ble_fra
         //     rt = rsp_data_len;
         //     goto __ERR;
         // }
-        key = sg_ble_service_params->key_1;
+        key = &sg_ble_service_params->key_1_ctx;
         encrypt_mode = ENCRYPTION_MODE_KEY_1;
         break;
     case APP_CMD_PAIR_REQ:
@@ -677,14 +685,14 @@ static int ble_recv_cmd_process(tuya_ble_frame_plain_s *recv_frame, tuya_ble_fra
         {
             rsp_data[0] = 1;
         }
-        key = sg_ble_service_params->key_2;
+        key = &sg_ble_service_params->key_2_ctx;
         encrypt_mode = ENCRYPTION_MODE_KEY_2;
         break;
     case APP_CMD_GET_TOKEN:
         ble_msg_queue_insert(BLE_SVC_STATUS_GET_TOKEN, recv_frame->len, recv_frame->data);
         rsp_data_len = 1;
         rsp_data[0] = 0;
-        key = sg_ble_service_params->key_2;
+        key = &sg_ble_service_params->key_2_ctx;
         encrypt_mode = ENCRYPTION_MODE_KEY_2;
         break;
     default:
@@ -727,7 +735,7 @@ static int ble_recv_cmd_process(tuya_ble_frame_plain_s *recv_frame, tuya_ble_fra
     get_random(rsp_frame->iv, FRAME_IV_SIZE);
     memcpy(iv, rsp_frame->iv, FRAME_IV_SIZE);
 
-    TUYA_CALL_ERR_GOTO(tal_aes128_cbc_encode_raw((uint8_t *)plaintext, plaintext_size, key, iv, rsp_frame->ciphertext), __ERR);
+    TUYA_CALL_ERR_GOTO(aes128_cbc_encode_raw_ctx((uint8_t *)plaintext, plaintext_size, key, iv, rsp_frame->ciphertext), __ERR);
 
     if (NULL != (plaintext))
     {
@@ -1191,6 +1199,8 @@ int ble_service_loop(void)
 
         if (NULL != sg_ble_service_params)
         {
+            aes128_key_ctx_free(&sg_ble_service_params->key_1_ctx);
+            aes128_key_ctx_free(&sg_ble_service_params->key_2_ctx);
             system_free(sg_ble_service_params);
             sg_ble_service_params = NULL;
         }
@@ -0,0 +1,341 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "tuya_log.h"
+#include "tuya_error_code.h"
+#include "tuya_dp.h"
+
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t i;
+} dp_reader_t;
+
+static void dp_skip_space(dp_reader_t* r)
+{
+    while (r->i < r->len &&
+           (r->buf[r->i] == ' ' || r->buf[r->i] == '\t' || r->buf[r->i] == '\n' || r->buf[r->i] == '\r')) {
+        r->i++;
+    }
+}
+
+static bool dp_expect(dp_reader_t* r, char c)
+{
+    dp_skip_space(r);
+    if (r->i < r->len && r->buf[r->i] == c) {
+        r->i++;
+        return true;
+    }
+    return false;
+}
+
+static bool dp_literal(dp_reader_t* r, const char* word)
+{
+    size_t n = strlen(word);
+    if (r->len - r->i < n || memcmp(r->buf + r->i, word, n) != 0) {
+        return false;
+    }
+    r->i += n;
+    return true;
+}
+
+static int32_t dp_hex4(const char* p)
+{
+    int32_t v = 0;
+    int i;
+    for (i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') {
+            v |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            v |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return v;
+}
+
+static size_t dp_utf8(char* out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/* Reader just past the opening quote. Unescapes in place, the output never
+ * outgrows the escape it came from, and NUL terminates over the closing quote. */
+static bool dp_string(dp_reader_t* r, char** out, size_t* out_len)
+{
+    char* dst = r->buf + r->i;
+    *out = dst;
+
+    while (r->i < r->len) {
+        char c = r->buf[r->i++];
+        if (c == '"') {
+            *out_len = dst - *out;
+            *dst = '\0';
+            return true;
+        }
+        if ((unsigned char)c < 0x20) {
+            return false;
+        }
+        if (c != '\\') {
+            *dst++ = c;
+            continue;
+        }
+
+        if (r->i >= r->len) {
+            return false;
+        }
+        c = r->buf[r->i++];
+        switch (c) {
+            case '"':
+            case '\\':
+            case '/': *dst++ = c; break;
+            case 'b': *dst++ = '\b'; break;
+            case 'f': *dst++ = '\f'; break;
+            case 'n': *dst++ = '\n'; break;
+            case 'r': *dst++ = '\r'; break;
+            case 't': *dst++ = '\t'; break;
+            case 'u': {
+                if (r->len - r->i < 4) {
+                    return false;
+                }
+                int32_t cp = dp_hex4(r->buf + r->i);
+                if (cp < 0 || (cp >= 0xDC00 && cp <= 0xDFFF)) {
+                    return false;
+                }
+                r->i += 4;
+
+                /* A high surrogate has to be followed by its low half */
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    if (r->len - r->i < 6 || r->buf[r->i] != '\\' || r->buf[r->i + 1] != 'u') {
+                        return false;
+                    }
+                    int32_t low = dp_hex4(r->buf + r->i + 2);
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    r->i += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                dst += dp_utf8(dst, (uint32_t)cp);
+                break;
+            }
+            default: return false;
+        }
+    }
+    return false;
+}
+
+static bool dp_skip_string(dp_reader_t* r)
+{
+    while (r->i < r->len) {
+        char c = r->buf[r->i++];
+        if (c == '\\') {
+            r->i++;
+        } else if (c == '"') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Reader on the opening bracket */
+static bool dp_skip_collection(dp_reader_t* r)
+{
+    uint32_t depth = 0;
+
+    while (r->i < r->len) {
+        char c = r->buf[r->i++];
+        if (c == '"') {
+            if (!dp_skip_string(r)) {
+                return false;
+            }
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* integer is false for fractions, exponents and anything outside int32_t */
+static bool dp_number(dp_reader_t* r, bool* integer, int32_t* value)
+{
+    bool negative = false;
+    int64_t v = 0;
+
+    if (r->buf[r->i] == '-') {
+        negative = true;
+        r->i++;
+    }
+    if (r->i >= r->len || r->buf[r->i] < '0' || r->buf[r->i] > '9') {
+        return false;
+    }
+
+    *integer = true;
+    while (r->i < r->len && r->buf[r->i] >= '0' && r->buf[r->i] <= '9') {
+        if (v <= INT32_MAX) {
+            v = v * 10 + (r->buf[r->i] - '0');
+        } else {
+            *integer = false;
+        }
+        r->i++;
+    }
+
+    if (r->i < r->len && r->buf[r->i] == '.') {
+        r->i++;
+        if (r->i >= r->len || r->buf[r->i] < '0' || r->buf[r->i] > '9') {
+            return false;
+        }
+        while (r->i < r->len && r->buf[r->i] >= '0' && r->buf[r->i] <= '9') {
+            r->i++;
+        }
+        *integer = false;
+    }
+
+    if (r->i < r->len && (r->buf[r->i] == 'e' || r->buf[r->i] == 'E')) {
+        r->i++;
+        if (r->i < r->len && (r->buf[r->i] == '+' || r->buf[r->i] == '-')) {
+            r->i++;
+        }
+        if (r->i >= r->len || r->buf[r->i] < '0' || r->buf[r->i] > '9') {
+            return false;
+        }
+        while (r->i < r->len && r->buf[r->i] >= '0' && r->buf[r->i] <= '9') {
+            r->i++;
+        }
+        *integer = false;
+    }
+
+    v = negative ? -v : v;
+    if (v < INT32_MIN || v > INT32_MAX) {
+        *integer = false;
+    }
+    *value = (int32_t)v;
+    return true;
+}
+
+static bool dp_id_parse(const char* key, size_t len, uint8_t* id)
+{
+    uint32_t v = 0;
+    size_t i;
+
+    if (len == 0 || len > 3) {
+        return false;
+    }
+    for (i = 0; i < len; i++) {
+        if (key[i] < '0' || key[i] > '9') {
+            return false;
+        }
+        v = v * 10 + (key[i] - '0');
+    }
+    if (v == 0 || v > TUYA_DP_ID_MAX) {
+        return false;
+    }
+    *id = (uint8_t)v;
+    return true;
+}
+
+int tuya_dp_parse(char* dps, size_t len, tuya_dp_cb_t cb, void* user_data)
+{
+    if (dps == NULL || cb == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    dp_reader_t r = {.buf = dps, .len = len, .i = 0};
+
+    if (!dp_expect(&r, '{')) {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    if (dp_expect(&r, '}')) {
+        return OPRT_OK;
+    }
+
+    do {
+        tuya_dp_t dp;
+        char* key;
+        size_t key_len;
+
+        if (!dp_expect(&r, '"') || !dp_string(&r, &key, &key_len) || !dp_expect(&r, ':')) {
+            return OPRT_CJSON_PARSE_ERR;
+        }
+        bool valid = dp_id_parse(key, key_len, &dp.id);
+
+        dp_skip_space(&r);
+        if (r.i >= r.len) {
+            return OPRT_CJSON_PARSE_ERR;
+        }
+
+        char c = r.buf[r.i];
+        if (c == '"') {
+            char* str;
+            size_t str_len;
+            r.i++;
+            if (!dp_string(&r, &str, &str_len)) {
+                return OPRT_CJSON_PARSE_ERR;
+            }
+            dp.type = TUYA_DP_TYPE_STRING;
+            dp.value.asString.str = str;
+            dp.value.asString.len = str_len;
+        } else if (c == 't' || c == 'f') {
+            dp.type = TUYA_DP_TYPE_BOOL;
+            dp.value.asBool = c == 't';
+            if (!dp_literal(&r, c == 't' ? "true" : "false")) {
+                return OPRT_CJSON_PARSE_ERR;
+            }
+        } else if (c == 'n') {
+            if (!dp_literal(&r, "null")) {
+                return OPRT_CJSON_PARSE_ERR;
+            }
+            valid = false;
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            bool integer;
+            dp.type = TUYA_DP_TYPE_VALUE;
+            if (!dp_number(&r, &integer, &dp.value.asValue)) {
+                return OPRT_CJSON_PARSE_ERR;
+            }
+            valid = valid && integer;
+        } else if (c == '{' || c == '[') {
+            if (!dp_skip_collection(&r)) {
+                return OPRT_CJSON_PARSE_ERR;
+            }
+            valid = false;
+        } else {
+            return OPRT_CJSON_PARSE_ERR;
+        }
+
+        if (valid) {
+            cb(&dp, user_data);
+        } else {
+            TY_LOGW("dp \"%s\" skipped", key);
+        }
+    } while (dp_expect(&r, ','));
+
+    return dp_expect(&r, '}') ? OPRT_OK : OPRT_CJSON_PARSE_ERR;
+}
@@ -0,0 +1,568 @@
+#include <stdint.h>
+#include <string.h>
+#include "tuya_log.h"
+#include "tuya_error_code.h"
+#include "system_interface.h"
+#include "tuya_dp_schema.h"
+#include "cJSON.h"
+#include "base64.h"
+
+#define DP_BIT(id) (1U << ((id) % 32))
+#define DP_WORD(id) ((id) / 32)
+
+/* Compiled table: header, entries, then the NUL separated enum labels */
+typedef struct {
+    uint8_t version;
+    uint8_t count;
+    uint16_t labels_length;
+} dp_schema_header_t;
+
+static int dp_schema_type(const char* type)
+{
+    static const char* const names[] = {
+        [TUYA_DP_TYPE_RAW] = "raw",
+        [TUYA_DP_TYPE_BOOL] = "bool",
+        [TUYA_DP_TYPE_VALUE] = "value",
+        [TUYA_DP_TYPE_STRING] = "string",
+        [TUYA_DP_TYPE_ENUM] = "enum",
+        [TUYA_DP_TYPE_BITMAP] = "bitmap",
+    };
+    size_t i;
+
+    for (i = 0; type && i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(type, names[i]) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static uint8_t dp_schema_mode(const char* mode)
+{
+    if (mode && strcmp(mode, "ro") == 0) {
+        return TUYA_DP_MODE_RO;
+    }
+    if (mode && strcmp(mode, "wr") == 0) {
+        return TUYA_DP_MODE_WR;
+    }
+    return TUYA_DP_MODE_RW;
+}
+
+static int32_t dp_schema_number(const cJSON* object, const char* name, int32_t fallback)
+{
+    const cJSON* item = cJSON_GetObjectItem(object, name);
+    return cJSON_IsNumber(item) ? item->valueint : fallback;
+}
+
+/* Labels are written back out as JSON strings, so only ones that need no escaping are kept */
+static bool dp_schema_label_valid(const char* label)
+{
+    const char* p;
+    for (p = label; *p; p++) {
+        if (*p == '"' || *p == '\\' || (unsigned char)*p < 0x20) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char* dp_schema_label(const tuya_dp_schema_t* schema, const tuya_dp_schema_entry_t* entry, uint32_t index)
+{
+    const char* label = schema->labels + entry->labels;
+    while (index--) {
+        label += strlen(label) + 1;
+    }
+    return label;
+}
+
+static bool dp_schema_bitmap_fits(const tuya_dp_schema_entry_t* entry, uint32_t value)
+{
+    return entry->max >= 32 || (value >> entry->max) == 0;
+}
+
+int tuya_dp_schema_compile(const char* json, uint8_t* table, size_t* length)
+{
+    if (json == NULL || table == NULL || length == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    cJSON* root = cJSON_Parse(json);
+    if (!cJSON_IsArray(root)) {
+        cJSON_Delete(root);
+        return OPRT_CJSON_PARSE_ERR;
+    }
+
+    /* Room for every item up front, the labels are moved down behind the kept ones at the end */
+    size_t items = cJSON_GetArraySize(root);
+    size_t labels_start = sizeof(dp_schema_header_t) + items * sizeof(tuya_dp_schema_entry_t);
+    if (labels_start > *length) {
+        cJSON_Delete(root);
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    tuya_dp_schema_entry_t* entries = (tuya_dp_schema_entry_t*)(table + sizeof(dp_schema_header_t));
+    char* labels = (char*)table + labels_start;
+    size_t labels_size = *length - labels_start;
+    size_t labels_length = 0;
+    uint32_t seen[(TUYA_DP_ID_MAX + 1) / 32] = {0};
+    size_t count = 0;
+    cJSON* item;
+
+    cJSON_ArrayForEach(item, root) {
+        cJSON* property = cJSON_GetObjectItem(item, "property");
+        int32_t id = dp_schema_number(item, "id", 0);
+        int type = dp_schema_type(cJSON_GetStringValue(cJSON_GetObjectItem(property ? property : item, "type")));
+
+        if (id <= 0 || id > TUYA_DP_ID_MAX || type < 0 || (seen[DP_WORD(id)] & DP_BIT(id))) {
+            TY_LOGW("schema dp %d skipped", (int)id);
+            continue;
+        }
+
+        tuya_dp_schema_entry_t entry = {
+            .id = (uint8_t)id,
+            .type = (uint8_t)type,
+            .mode = dp_schema_mode(cJSON_GetStringValue(cJSON_GetObjectItem(item, "mode")))};
+
+        switch (type) {
+            case TUYA_DP_TYPE_VALUE:
+                entry.min = dp_schema_number(property, "min", INT32_MIN);
+                entry.max = dp_schema_number(property, "max", INT32_MAX);
+                entry.scale = (uint8_t)dp_schema_number(property, "scale", 0);
+                break;
+
+            case TUYA_DP_TYPE_ENUM: {
+                cJSON* range = cJSON_GetObjectItem(property, "range");
+                cJSON* label;
+                size_t start = labels_length;
+
+                cJSON_ArrayForEach(label, range) {
+                    const char* name = cJSON_GetStringValue(label);
+                    size_t name_length = name ? strlen(name) + 1 : 0;
+                    if (name == NULL || !dp_schema_label_valid(name) || name_length > labels_size - labels_length) {
+                        break;
+                    }
+                    memcpy(labels + labels_length, name, name_length);
+                    labels_length += name_length;
+                    entry.max++;
+                }
+                if (label != NULL || entry.max == 0 || labels_length > UINT16_MAX) {
+                    TY_LOGW("schema dp %d enum range skipped", (int)id);
+                    labels_length = start;
+                    continue;
+                }
+                entry.max--;
+                entry.labels = (uint16_t)start;
+                break;
+            }
+
+            case TUYA_DP_TYPE_BITMAP:
+                entry.max = dp_schema_number(property, "maxlen", cJSON_GetArraySize(cJSON_GetObjectItem(property, "label")));
+                break;
+
+            case TUYA_DP_TYPE_STRING:
+            case TUYA_DP_TYPE_RAW:
+                entry.max = dp_schema_number(property, "maxlen", 0);
+                break;
+
+            default:
+                break;
+        }
+
+        if (entry.min > entry.max) {
+            TY_LOGW("schema dp %d range skipped", (int)id);
+            continue;
+        }
+
+        seen[DP_WORD(id)] |= DP_BIT(id);
+        entries[count++] = entry;
+    }
+    cJSON_Delete(root);
+
+    dp_schema_header_t header = {
+        .version = TUYA_DP_SCHEMA_VERSION,
+        .count = (uint8_t)count,
+        .labels_length = (uint16_t)labels_length};
+    memcpy(table, &header, sizeof(header));
+    memmove(&entries[count], labels, labels_length);
+    *length = (uint8_t*)&entries[count] - table + labels_length;
+
+    TY_LOGD("schema compiled, %d dps in %d bytes", (int)count, (int)*length);
+    return OPRT_OK;
+}
+
+int tuya_dp_schema_load(tuya_dp_schema_t* schema, const uint8_t* table, size_t length)
+{
+    if (schema == NULL || table == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+    tuya_dp_schema_free(schema);
+
+    dp_schema_header_t header;
+    if (length < sizeof(header)) {
+        return OPRT_INVALID_PARM;
+    }
+    memcpy(&header, table, sizeof(header));
+
+    size_t entries_length = header.count * sizeof(tuya_dp_schema_entry_t);
+    if (header.version != TUYA_DP_SCHEMA_VERSION ||
+        length != sizeof(header) + entries_length + header.labels_length ||
+        (header.labels_length && table[length - 1] != '\0')) {
+        return OPRT_INVALID_PARM;
+    }
+
+    /* Values first, the table copy behind them stays aligned for its entries */
+    size_t values_length = header.count * sizeof(int32_t);
+    uint8_t* buffer = system_malloc(values_length + length);
+    TUYA_CHECK_NULL_RETURN(buffer, OPRT_MALLOC_FAILED);
+    memset(buffer, 0, values_length);
+    memcpy(buffer + values_length, table, length);
+
+    schema->buffer = buffer;
+    schema->values = (int32_t*)buffer;
+    schema->entries = (const tuya_dp_schema_entry_t*)(buffer + values_length + sizeof(header));
+    schema->labels = (const char*)&schema->entries[header.count];
+    schema->count = header.count;
+
+    uint8_t i;
+    for (i = 0; i < header.count; i++) {
+        const tuya_dp_schema_entry_t* entry = &schema->entries[i];
+        bool valid = entry->id != 0 && schema->index[entry->id] == 0 &&
+                     entry->type <= TUYA_DP_TYPE_BITMAP && entry->mode <= TUYA_DP_MODE_WR &&
+                     entry->min <= entry->max;
+
+        /* Every label of an enum has to end inside the pool */
+        if (valid && entry->type == TUYA_DP_TYPE_ENUM) {
+            size_t offset = entry->labels;
+            int32_t n;
+            for (n = 0; valid && n <= entry->max; n++) {
+                valid = offset < header.labels_length;
+                offset += valid ? strlen(schema->labels + offset) + 1 : 0;
+            }
+        }
+
+        if (!valid) {
+            TY_LOGE("schema table dp %d invalid", entry->id);
+            tuya_dp_schema_free(schema);
+            return OPRT_INVALID_PARM;
+        }
+        schema->index[entry->id] = i + 1;
+    }
+
+    return OPRT_OK;
+}
+
+void tuya_dp_schema_free(tuya_dp_schema_t* schema)
+{
+    if (schema->buffer) {
+        system_free(schema->buffer);
+    }
+    memset(schema, 0, sizeof(tuya_dp_schema_t));
+}
+
+int tuya_dp_schema_decode(const tuya_dp_schema_t* schema, tuya_dp_t* dp)
+{
+    const tuya_dp_schema_entry_t* entry = tuya_dp_schema_find(schema, dp->id);
+    if (entry == NULL) {
+        return OPRT_NOT_FOUND;
+    }
+    if (entry->mode == TUYA_DP_MODE_RO) {
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    switch (entry->type) {
+        case TUYA_DP_TYPE_BOOL:
+            return dp->type == TUYA_DP_TYPE_BOOL ? OPRT_OK : OPRT_INVALID_PARM;
+
+        case TUYA_DP_TYPE_VALUE:
+            if (dp->type != TUYA_DP_TYPE_VALUE || dp->value.asValue < entry->min || dp->value.asValue > entry->max) {
+                return OPRT_INVALID_PARM;
+            }
+            return OPRT_OK;
+
+        case TUYA_DP_TYPE_BITMAP:
+            if (dp->type != TUYA_DP_TYPE_VALUE || dp->value.asValue < 0 ||
+                !dp_schema_bitmap_fits(entry, (uint32_t)dp->value.asValue)) {
+                return OPRT_INVALID_PARM;
+            }
+            dp->type = TUYA_DP_TYPE_BITMAP;
+            dp->value.asBitmap = (uint32_t)dp->value.asValue;
+            return OPRT_OK;
+
+        case TUYA_DP_TYPE_ENUM: {
+            if (dp->type != TUYA_DP_TYPE_STRING) {
+                return OPRT_INVALID_PARM;
+            }
+            const char* label = schema->labels + entry->labels;
+            uint32_t n;
+            for (n = 0; n <= (uint32_t)entry->max; n++) {
+                size_t label_length = strlen(label);
+                if (label_length == dp->value.asString.len && memcmp(label, dp->value.asString.str, label_length) == 0) {
+                    dp->type = TUYA_DP_TYPE_ENUM;
+                    dp->value.asEnum = n;
+                    return OPRT_OK;
+                }
+                label += label_length + 1;
+            }
+            return OPRT_INVALID_PARM;
+        }
+
+        case TUYA_DP_TYPE_STRING:
+            if (dp->type != TUYA_DP_TYPE_STRING || (entry->max && dp->value.asString.len > (size_t)entry->max)) {
+                return OPRT_INVALID_PARM;
+            }
+            return OPRT_OK;
+
+        case TUYA_DP_TYPE_RAW: {
+            if (dp->type != TUYA_DP_TYPE_STRING) {
+                return OPRT_INVALID_PARM;
+            }
+            /* The string sits in the writable message buffer tuya_dp_parse unescaped it in,
+             * decoding in place is safe as the output never overtakes the input */
+            uint8_t* data = (uint8_t*)dp->value.asString.str;
+            size_t data_length;
+            if (mbedtls_base64_decode(data, dp->value.asString.len, &data_length, data, dp->value.asString.len) != 0 ||
+                (entry->max && data_length > (size_t)entry->max)) {
+                return OPRT_INVALID_PARM;
+            }
+            dp->type = TUYA_DP_TYPE_RAW;
+            dp->value.asRaw.data = data;
+            dp->value.asRaw.len = data_length;
+            return OPRT_OK;
+        }
+
+        default:
+            return OPRT_INVALID_PARM;
+    }
+}
+
+int tuya_dp_schema_set(tuya_dp_schema_t* schema, const tuya_dp_t* dp)
+{
+    const tuya_dp_schema_entry_t* entry = tuya_dp_schema_find(schema, dp->id);
+    int32_t value;
+
+    if (entry == NULL) {
+        return OPRT_NOT_FOUND;
+    }
+    if (dp->type != entry->type) {
+        return OPRT_INVALID_PARM;
+    }
+
+    switch (entry->type) {
+        case TUYA_DP_TYPE_BOOL:
+            value = dp->value.asBool;
+            break;
+
+        case TUYA_DP_TYPE_VALUE:
+            if (dp->value.asValue < entry->min || dp->value.asValue > entry->max) {
+                return OPRT_INVALID_PARM;
+            }
+            value = dp->value.asValue;
+            break;
+
+        case TUYA_DP_TYPE_ENUM:
+            if (dp->value.asEnum > (uint32_t)entry->max) {
+                return OPRT_INVALID_PARM;
+            }
+            value = (int32_t)dp->value.asEnum;
+            break;
+
+        case TUYA_DP_TYPE_BITMAP:
+            if (!dp_schema_bitmap_fits(entry, dp->value.asBitmap)) {
+                return OPRT_INVALID_PARM;
+            }
+            value = (int32_t)dp->value.asBitmap;
+            break;
+
+        default:
+            /* Strings and raw are not kept, report them as JSON */
+            return OPRT_NOT_SUPPORTED;
+    }
+
+    /* Marked even when unchanged, a command is answered with the state it left */
+    __atomic_store_n(&schema->values[schema->index[dp->id] - 1], value, __ATOMIC_RELAXED);
+    __atomic_fetch_or(&schema->valid[DP_WORD(dp->id)], DP_BIT(dp->id), __ATOMIC_RELEASE);
+    __atomic_fetch_or(&schema->dirty[DP_WORD(dp->id)], DP_BIT(dp->id), __ATOMIC_RELEASE);
+    return OPRT_OK;
+}
+
+int tuya_dp_schema_get(const tuya_dp_schema_t* schema, uint8_t id, tuya_dp_t* dp)
+{
+    const tuya_dp_schema_entry_t* entry = tuya_dp_schema_find(schema, id);
+
+    if (entry == NULL || !(__atomic_load_n(&schema->valid[DP_WORD(id)], __ATOMIC_ACQUIRE) & DP_BIT(id))) {
+        return OPRT_NOT_FOUND;
+    }
+
+    int32_t value = __atomic_load_n(&schema->values[schema->index[id] - 1], __ATOMIC_RELAXED);
+    dp->id = id;
+    dp->type = (tuya_dp_type_t)entry->type;
+    switch (entry->type) {
+        case TUYA_DP_TYPE_BOOL: dp->value.asBool = value != 0; break;
+        case TUYA_DP_TYPE_ENUM: dp->value.asEnum = (uint32_t)value; break;
+        case TUYA_DP_TYPE_BITMAP: dp->value.asBitmap = (uint32_t)value; break;
+        default: dp->value.asValue = value; break;
+    }
+    return OPRT_OK;
+}
+
+/* Bytes "id":value of one DP may take behind its comma */
+static size_t dp_schema_dp_bound(const tuya_dp_schema_t* schema, const tuya_dp_t* dp)
+{
+    const tuya_dp_schema_entry_t* entry = tuya_dp_schema_find(schema, dp->id);
+    size_t size = sizeof("\"255\":") - 1;
+
+    switch (dp->type) {
+        case TUYA_DP_TYPE_ENUM:
+            if (entry && entry->type == TUYA_DP_TYPE_ENUM && dp->value.asEnum <= (uint32_t)entry->max) {
+                size += strlen(dp_schema_label(schema, entry, dp->value.asEnum)) + 2;
+            }
+            break;
+        case TUYA_DP_TYPE_STRING:
+            size += dp->value.asString.len * 6 + 2;
+            break;
+        case TUYA_DP_TYPE_RAW:
+            size += (dp->value.asRaw.len + 2) / 3 * 4 + 2;
+            break;
+        default:
+            size += sizeof("-2147483648") - 1;
+            break;
+    }
+    return size;
+}
+
+static int dp_schema_dp_write(const tuya_dp_schema_t* schema, json_writer_t* writer, const tuya_dp_t* dp)
+{
+    const tuya_dp_schema_entry_t* entry = tuya_dp_schema_find(schema, dp->id);
+
+    /* Outside a loaded schema only enums, which need its names, are refused */
+    if (tuya_dp_schema_loaded(schema) && (entry == NULL || entry->type != dp->type)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    json_writer_raw(writer, "\"", 1);
+    json_writer_int(writer, dp->id);
+    json_writer_raw(writer, "\":", 2);
+
+    switch (dp->type) {
+        case TUYA_DP_TYPE_BOOL:
+            json_writer_bool(writer, dp->value.asBool);
+            break;
+        case TUYA_DP_TYPE_VALUE:
+            json_writer_int(writer, dp->value.asValue);
+            break;
+        case TUYA_DP_TYPE_BITMAP:
+            json_writer_int(writer, dp->value.asBitmap);
+            break;
+        case TUYA_DP_TYPE_STRING:
+            json_writer_string(writer, dp->value.asString.str, dp->value.asString.len);
+            break;
+        case TUYA_DP_TYPE_RAW:
+            json_writer_base64(writer, dp->value.asRaw.data, dp->value.asRaw.len);
+            break;
+        case TUYA_DP_TYPE_ENUM:
+            if (entry == NULL || entry->type != TUYA_DP_TYPE_ENUM || dp->value.asEnum > (uint32_t)entry->max) {
+                return OPRT_INVALID_PARM;
+            }
+            /* Labels were checked to need no escaping when compiled */
+            json_writer_raw(writer, "\"", 1);
+            json_writer_literal(writer, dp_schema_label(schema, entry, dp->value.asEnum));
+            json_writer_raw(writer, "\"", 1);
+            break;
+        default:
+            return OPRT_INVALID_PARM;
+    }
+    return OPRT_OK;
+}
+
+void tuya_dp_schema_dirty_take(tuya_dp_schema_t* schema, tuya_dp_marks_t* marks)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(marks->bits) / sizeof(marks->bits[0]); i++) {
+        marks->bits[i] = __atomic_exchange_n(&schema->dirty[i], 0, __ATOMIC_ACQUIRE);
+    }
+}
+
+void tuya_dp_schema_dirty_restore(tuya_dp_schema_t* schema, const tuya_dp_marks_t* marks)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(marks->bits) / sizeof(marks->bits[0]); i++) {
+        __atomic_fetch_or(&schema->dirty[i], marks->bits[i], __ATOMIC_RELAXED);
+    }
+}
+
+static inline bool dp_schema_marked(const tuya_dp_marks_t* marks, uint8_t id)
+{
+    return (marks->bits[DP_WORD(id)] & DP_BIT(id)) != 0;
+}
+
+size_t tuya_dp_schema_serialize_bound(const tuya_dp_schema_t* schema, const tuya_dp_marks_t* marks)
+{
+    size_t size = sizeof("{}") - 1;
+    tuya_dp_t dp;
+    uint8_t i;
+
+    for (i = 0; i < schema->count; i++) {
+        uint8_t id = schema->entries[i].id;
+        if (dp_schema_marked(marks, id) && tuya_dp_schema_get(schema, id, &dp) == OPRT_OK) {
+            size += 1 + dp_schema_dp_bound(schema, &dp);
+        }
+    }
+    return size;
+}
+
+int tuya_dp_schema_serialize(const tuya_dp_schema_t* schema, const tuya_dp_marks_t* marks, json_writer_t* writer)
+{
+    bool first = true;
+    tuya_dp_t dp;
+    uint8_t i;
+
+    json_writer_raw(writer, "{", 1);
+    for (i = 0; i < schema->count; i++) {
+        uint8_t id = schema->entries[i].id;
+        if (!dp_schema_marked(marks, id) || tuya_dp_schema_get(schema, id, &dp) != OPRT_OK) {
+            continue;
+        }
+        if (!first) {
+            json_writer_raw(writer, ",", 1);
+        }
+        first = false;
+        dp_schema_dp_write(schema, writer, &dp);
+    }
+    json_writer_raw(writer, "}", 1);
+
+    return writer->overflow ? OPRT_EXCEED_UPPER_LIMIT : OPRT_OK;
+}
+
+size_t tuya_dp_schema_values_bound(const tuya_dp_schema_t* schema, const tuya_dp_t* dps, size_t count)
+{
+    size_t size = sizeof("{}") - 1;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        size += 1 + dp_schema_dp_bound(schema, &dps[i]);
+    }
+    return size;
+}
+
+int tuya_dp_schema_values_serialize(const tuya_dp_schema_t* schema, json_writer_t* writer, const tuya_dp_t* dps, size_t count)
+{
+    size_t i;
+
+    json_writer_raw(writer, "{", 1);
+    for (i = 0; i < count; i++) {
+        if (i) {
+            json_writer_raw(writer, ",", 1);
+        }
+        int rt = dp_schema_dp_write(schema, writer, &dps[i]);
+        if (rt != OPRT_OK) {
+            TY_LOGE("dp %d not serializable:%d", dps[i].id, rt);
+            return rt;
+        }
+    }
+    json_writer_raw(writer, "}", 1);
+
+    return writer->overflow ? OPRT_EXCEED_UPPER_LIMIT : OPRT_OK;
+}
+
@@ -11,11 +11,16 @@
 
 #include "system_interface.h"
 #include "storage_interface.h"
+#include "crypto_interface.h"
+#include "network_interface.h"
 #include "atop_base.h"
 #include "atop_service.h"
 #include "mqtt_bind.h"
 #include "cJSON.h"
 #include "MultiTimer.h"
+#include "cjson_arena.h"
+#include "core_json.h"
+#include "tuya_dp_schema.h"
 
 typedef enum
 {
@@ -117,6 +122,66 @@ static int activated_data_read(const char *storage_key, tuya_activated_data_t *o
     return rt;
 }
 
+/* -------------------------------------------------------------------------- */
+/*                              DP schema process                             */
+/* -------------------------------------------------------------------------- */
+
+static int dp_schema_compile_save(tuya_iot_client_t *client, const char *schema)
+{
+    char schema_key[MAX_LENGTH_UUID + 8];
+    size_t length = DP_SCHEMA_TABLE_LENGTH;
+    uint8_t *table = system_malloc(DP_SCHEMA_TABLE_LENGTH);
+    TUYA_CHECK_NULL_RETURN(table, OPRT_MALLOC_FAILED);
+
+    int rt = tuya_dp_schema_compile(schema, table, &length);
+    if (rt == OPRT_OK)
+    {
+        snprintf(schema_key, sizeof schema_key, "%s.schema", client->config.storage_namespace);
+        rt = local_storage_set(schema_key, table, length);
+    }
+    if (rt == OPRT_OK)
+    {
+        rt = tuya_dp_schema_load(&client->dp_schema, table, length);
+    }
+    system_free(table);
+    return rt;
+}
+
+static int dp_schema_read(tuya_iot_client_t *client)
+{
+    char schema_key[MAX_LENGTH_UUID + 8];
+    size_t length = DP_SCHEMA_TABLE_LENGTH;
+    uint8_t *table = system_malloc(DP_SCHEMA_TABLE_LENGTH);
+    TUYA_CHECK_NULL_RETURN(table, OPRT_MALLOC_FAILED);
+
+    snprintf(schema_key, sizeof schema_key, "%s.schema", client->config.storage_namespace);
+    int rt = local_storage_get(schema_key, table, &length);
+    if (rt == OPRT_OK)
+    {
+        rt = tuya_dp_schema_load(&client->dp_schema, table, length);
+    }
+    system_free(table);
+    if (rt == OPRT_OK)
+    {
+        return rt;
+    }
+
+    /* Activated before schemas were compiled, or by an older table layout,
+     * compile again from the schema JSON saved at activation */
+    TY_LOGW("dp schema table not found:%d, compile", rt);
+    length = ACTIVATE_BUFFER_LENGTH;
+    char *schema = system_calloc(1, ACTIVATE_BUFFER_LENGTH + 1);
+    TUYA_CHECK_NULL_RETURN(schema, OPRT_MALLOC_FAILED);
+
+    rt = local_storage_get(client->activate.schemaId, (uint8_t *)schema, &length);
+    if (rt == OPRT_OK)
+    {
+        rt = dp_schema_compile_save(client, schema);
+    }
+    system_free(schema);
+    return rt;
+}
+
 static int activate_response_parse(atop_base_response_t *response)
 {
     if (response->success != true || response->result == NULL)
@@ -140,13 +205,21 @@ static int activate_response_parse(atop_base_response_t *response)
     char *schemaId = cJSON_GetObjectItem(result_root, "schemaId")->valuestring;
     cJSON *schema_obj = cJSON_DetachItemFromObject(result_root, "schema");
     ret = local_storage_set(schemaId, (const uint8_t *)schema_obj->valuestring, strlen(schema_obj->valuestring));
-    cJSON_Delete(schema_obj);
     if (ret != OPRT_OK)
     {
+        cJSON_Delete(schema_obj);
         TY_LOGE("activate data save error:%d", ret);
         return OPRT_KVS_WR_FAIL;
     }
 
+    // compiled DP table, without one DPs just go unchecked
+    ret = dp_schema_compile_save(client, schema_obj->valuestring);
+    cJSON_Delete(schema_obj);
+    if (ret != OPRT_OK)
+    {
+        TY_LOGW("dp schema compile error:%d", ret);
+    }
+
     // activate info save
     char *result_string = cJSON_PrintUnformatted(result_root);
     const char *activate_data_key = client->config.storage_namespace;
@@ -265,7 +338,7 @@ static void mqtt_service_dp_receive_on(tuya_protocol_event_t *ev)
     client->event.type = TUYA_DATE_TYPE_STRING;
     client->event.value.asString = dps_string;
     iot_dispatch_event(client);
-    system_free(dps_string);
+    cJSON_free(dps_string);
 
     /* Send DP cJSON format event*/
     client->event.id = TUYA_EVENT_DP_RECEIVE_CJSON;
@@ -274,6 +347,51 @@ static void mqtt_service_dp_receive_on(tuya_protocol_event_t *ev)
     iot_dispatch_event(client);
 }
 
+static void mqtt_service_dp_value_on(const tuya_dp_t *dp, void *user_data)
+{
+    tuya_iot_client_t *client = (tuya_iot_client_t *)user_data;
+    tuya_dp_t value = *dp;
+
+    /* Check against the schema and give enum, bitmap and raw DPs their type */
+    if (tuya_dp_schema_loaded(&client->dp_schema))
+    {
+        int rt = tuya_dp_schema_decode(&client->dp_schema, &value);
+        if (rt != OPRT_OK)
+        {
+            TY_LOGW("dp %d rejected by schema:%d", value.id, rt);
+            return;
+        }
+    }
+
+    /* Send typed DP event */
+    client->event.id = TUYA_EVENT_DP_RECEIVE_VALUE;
+    client->event.type = TUYA_DATE_TYPE_DP;
+    client->event.value.asDP = &value;
+    iot_dispatch_event(client);
+    /* value only lives for this call */
+    client->event.value.asDP = NULL;
+}
+
+static void mqtt_service_dp_receive_raw_on(tuya_protocol_event_t *ev)
+{
+    tuya_iot_client_t *client = ev->user_data;
+    char *dps;
+    size_t dps_length;
+
+    if (JSON_Search(ev->raw_data, ev->raw_length, "dps", sizeof("dps") - 1, &dps, &dps_length) != JSONSuccess)
+    {
+        TY_LOGE("not found dps");
+        return;
+    }
+    TY_LOGV("dps: \r\n%.*s", (int)dps_length, dps);
+
+    int rt = tuya_dp_parse(dps, dps_length, mqtt_service_dp_value_on, client);
+    if (rt != OPRT_OK)
+    {
+        TY_LOGE("dps parse error:%d", rt);
+    }
+}
+
 static void mqtt_service_reset_cmd_on(tuya_protocol_event_t *ev)
 {
     tuya_iot_client_t *client = ev->user_data;
@@ -442,6 +560,154 @@ static void check_auto_upgrade_timeout_on(MultiTimer *timer, void *user_data)
     }
 }
 
+/* -------------------------------------------------------------------------- */
+/*                              DP report merging                             */
+/* -------------------------------------------------------------------------- */
+struct tuya_dp_report
+{
+    struct tuya_dp_report *next;
+    tuya_dp_notify_cb_t cb;
+    void *user_data;
+    int timeout_ms;
+    char dps[];
+};
+
+static int tuya_iot_dp_report_json_publish(tuya_iot_client_t *client, const char *dps, const char *time, tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms);
+
+/* A merged publish finished, every report it carried gets the result */
+static void dp_report_waiters_notify(int result, void *user_data)
+{
+    struct tuya_dp_report *waiter = (struct tuya_dp_report *)user_data;
+    while (waiter)
+    {
+        struct tuya_dp_report *next = waiter->next;
+        waiter->cb(result, waiter->user_data);
+        system_free(waiter);
+        waiter = next;
+    }
+}
+
+static void dp_report_window_timeout_on(MultiTimer *timer, void *user_data)
+{
+    tuya_iot_client_t *client = (tuya_iot_client_t *)user_data;
+
+    if (client->dp_report_pending == NULL)
+    {
+        return;
+    }
+
+    char *dps = cJSON_PrintUnformatted(client->dp_report_pending);
+    cJSON_Delete(client->dp_report_pending);
+    client->dp_report_pending = NULL;
+
+    struct tuya_dp_report *waiters = client->dp_report_waiters;
+    client->dp_report_waiters = NULL;
+
+    /* The merged publish waits as long as the most patient caller */
+    int timeout_ms = 0;
+    struct tuya_dp_report *waiter;
+    for (waiter = waiters; waiter; waiter = waiter->next)
+    {
+        if (waiter->timeout_ms > timeout_ms)
+        {
+            timeout_ms = waiter->timeout_ms;
+        }
+    }
+
+    int rt = OPRT_MALLOC_FAILED;
+    if (dps)
+    {
+        rt = tuya_iot_dp_report_json_publish(client, dps, NULL,
+                                             waiters ? dp_report_waiters_notify : NULL, waiters,
+                                             timeout_ms);
+        cJSON_free(dps);
+    }
+
+    /* Never queued, no PUBACK or timeout will report it */
+    if (rt != OPRT_OK)
+    {
+        TY_LOGE("merged dp report error:%d", rt);
+        dp_report_waiters_notify(rt, waiters);
+    }
+}
+
+/* Merge the reports queued by any task, the window opens with the first one */
+static void dp_report_queue_drain(tuya_iot_client_t *client)
+{
+    struct tuya_dp_report *report;
+
+    while ((report = mpsc_ring_pop(&client->dp_report_queue)) != NULL)
+    {
+        cJSON *dps = cJSON_Parse(report->dps);
+        if (!cJSON_IsObject(dps))
+        {
+            TY_LOGE("dp report parse error: %s", report->dps);
+            cJSON_Delete(dps);
+            if (report->cb)
+            {
+                report->cb(OPRT_CJSON_PARSE_ERR, report->user_data);
+            }
+            system_free(report);
+            continue;
+        }
+
+        if (client->dp_report_pending == NULL)
+        {
+            client->dp_report_pending = dps;
+            MultiTimerStart(&client->dp_report_timer, client->config.dp_report_window_ms);
+        }
+        else
+        {
+            /* Last value wins, items keep their key when moved */
+            cJSON *item;
+            while ((item = dps->child) != NULL)
+            {
+                cJSON_DetachItemViaPointer(dps, item);
+                cJSON *old = cJSON_GetObjectItemCaseSensitive(client->dp_report_pending, item->string);
+                if (old)
+                {
+                    cJSON_ReplaceItemViaPointer(client->dp_report_pending, old, item);
+                }
+                else
+                {
+                    cJSON_AddItemToArray(client->dp_report_pending, item);
+                }
+            }
+            cJSON_Delete(dps);
+        }
+
+        if (report->cb == NULL)
+        {
+            system_free(report);
+            continue;
+        }
+
+        /* Callers are notified in the order they reported */
+        struct tuya_dp_report **tail = &client->dp_report_waiters;
+        while (*tail)
+        {
+            tail = &(*tail)->next;
+        }
+        *tail = report;
+    }
+}
+
+/* Built-in protocol handlers, sorted by id. user_data is filled in with the client. */
+static const tuya_protocol_handle_t mqtt_service_protocols[] = {
+    {.id = PRO_CMD, .cb = mqtt_service_dp_receive_on},
+    {.id = PRO_GW_RESET, .cb = mqtt_service_reset_cmd_on},
+    {.id = PRO_UPGD_REQ, .cb = mqtt_service_upgrade_notify_on},
+    {.id = PRO_MQ_DPCACHE_NOTIFY, .cb = mqtt_atop_dp_cache_notify_cb},
+};
+
+/* Same length, with DP commands delivered typed, see dp_receive_typed */
+static const tuya_protocol_handle_t mqtt_service_protocols_typed[] = {
+    {.id = PRO_CMD, .raw = true, .cb = mqtt_service_dp_receive_raw_on},
+    {.id = PRO_GW_RESET, .cb = mqtt_service_reset_cmd_on},
+    {.id = PRO_UPGD_REQ, .cb = mqtt_service_upgrade_notify_on},
+    {.id = PRO_MQ_DPCACHE_NOTIFY, .cb = mqtt_atop_dp_cache_notify_cb},
+};
+
 /* -------------------------------------------------------------------------- */
 /*                       Internal machine state process                       */
 /* -------------------------------------------------------------------------- */
@@ -454,6 +720,7 @@ static int run_state_startup_update(tuya_iot_client_t *client)
     tuya_iot_version_update_sync(client);
 
     /* MQTT Client Init */
+    const tuya_protocol_handle_t *protocols = client->config.dp_receive_typed ? mqtt_service_protocols_typed : mqtt_service_protocols;
     const tuya_endpoint_t *endpoint = tuya_endpoint_get();
     rt = tuya_mqtt_init(&client->mqctx, &(const tuya_mqtt_config_t){
                                             .cacert = endpoint->mqtt.cert,
@@ -465,6 +732,8 @@ static int run_state_startup_update(tuya_iot_client_t *client)
                                             .localkey = client->activate.localkey,
                                             .timeout = MQTT_RECV_BLOCK_TIME_MS,
                                             .user_data = client,
+                                            .protocols = protocols,
+                                            .protocol_count = sizeof(mqtt_service_protocols) / sizeof(mqtt_service_protocols[0]),
                                             .on_connected = mqtt_client_connected_on,
                                             .on_disconnect = mqtt_client_disconnect_on,
                                             .on_unbind = mqtt_client_unbind_on,
@@ -482,12 +751,6 @@ static int run_state_mqtt_connect_start(tuya_iot_client_t *client)
         return rt;
     }
 
-    /* callback register */
-    tuya_mqtt_protocol_register(&client->mqctx, PRO_CMD, mqtt_service_dp_receive_on, client);
-    tuya_mqtt_protocol_register(&client->mqctx, PRO_GW_RESET, mqtt_service_reset_cmd_on, client);
-    tuya_mqtt_protocol_register(&client->mqctx, PRO_UPGD_REQ, mqtt_service_upgrade_notify_on, client);
-    tuya_mqtt_protocol_register(&client->mqctx, PRO_MQ_DPCACHE_NOTIFY, mqtt_atop_dp_cache_notify_cb, client);
-
     return rt;
 }
 
@@ -559,11 +822,17 @@ int tuya_iot_init(tuya_iot_client_t *client, const tuya_iot_config_t *config)
     /* Software timer Init */
     MultiTimerInstall(system_ticks);
 
-    /* cJSON init */
-    cJSON_Hooks hooks = {
-        .malloc_fn = system_malloc,
-        .free_fn = system_free};
-    cJSON_InitHooks(&hooks);
+    /* cJSON init, inbound messages are parsed into an arena */
+    if (cjson_arena_init(CJSON_ARENA_SIZE) != OPRT_OK)
+    {
+        TY_LOGW("cJSON arena malloc fail, use heap");
+    }
+
+    /* Platform AES backend, falls back to software AES if none */
+    if (crypto_aes_init() != OPRT_OK)
+    {
+        TY_LOGW("platform AES init fail, use software AES");
+    }
 
     /* Load Tuya cloud endpoint config */
     tuya_endpoint_init();
@@ -573,11 +842,26 @@ int tuya_iot_init(tuya_iot_client_t *client, const tuya_iot_config_t *config)
     if (activated_data_read(client->config.storage_namespace, &client->activate) == OPRT_OK)
     {
         client->is_activated = true;
+        if (dp_schema_read(client) != OPRT_OK)
+        {
+            TY_LOGW("dp schema not loaded, dps go unchecked");
+        }
     }
 
     /* Auto check upgrade timer init */
     MultiTimerInit(&client->check_upgrade_timer, AUTO_UPGRADE_CHECK_INTERVAL, check_auto_upgrade_timeout_on, client);
 
+    /* DP report merging, opt-in */
+    if (client->config.dp_report_window_ms)
+    {
+        ret = mpsc_ring_init(&client->dp_report_queue, DP_REPORT_QUEUE_LENGTH);
+        if (ret != OPRT_OK)
+        {
+            return ret;
+        }
+        MultiTimerInit(&client->dp_report_timer, 0, dp_report_window_timeout_on, client);
+    }
+
     client->state = STATE_IDLE;
     client->nextstate = STATE_IDLE;
     return ret;
@@ -590,12 +874,14 @@ int tuya_iot_start(tuya_iot_client_t *client)
         return OPRT_COM_ERROR;
     }
     client->nextstate = STATE_START;
+    network_wakeup();
     return OPRT_OK;
 }
 
 int tuya_iot_stop(tuya_iot_client_t *client)
 {
     client->nextstate = STATE_STOP;
+    network_wakeup();
     return OPRT_OK;
 }
 
@@ -606,6 +892,7 @@ int tuya_iot_reconnect(tuya_iot_client_t *client)
         return OPRT_COM_ERROR;
     }
     client->nextstate = STATE_MQTT_RECONNECT;
+    network_wakeup();
     return OPRT_OK;
 }
 
@@ -622,6 +909,7 @@ int tuya_iot_reset(tuya_iot_client_t *client)
     client->event.value.asInteger = TUYA_RESET_TYPE_FACTORY;
     iot_dispatch_event(client);
     client->nextstate = STATE_RESET;
+    network_wakeup();
     return ret;
 }
 
@@ -638,6 +926,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
     }
 
     int ret = OPRT_OK;
+    uint32_t wait_ms = 0;
     client->state = client->nextstate;
 
     switch (client->state)
@@ -645,10 +934,11 @@ int tuya_iot_yield(tuya_iot_client_t *client)
     case STATE_MQTT_YIELD:
         tuya_mqtt_loop(&client->mqctx);
         matop_serice_yield(&client->matop);
+        wait_ms = MQTT_RECV_BLOCK_TIME_MS;
         break;
 
     case STATE_IDLE:
-        system_sleep(500);
+        wait_ms = MQTT_RECV_BLOCK_TIME_MS;
         break;
 
     case STATE_START:
@@ -717,7 +1007,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
         ret = client_activate_process(client, client->binding->token);
         if (ret != OPRT_OK)
         {
-            system_sleep(1000);
+            wait_ms = 1000;
             break;
         }
 
@@ -791,9 +1081,22 @@ int tuya_iot_yield(tuya_iot_client_t *client)
         break;
     }
 
+    /* DP reports from other tasks, merged until the window timer fires */
+    if (client->config.dp_report_window_ms)
+    {
+        dp_report_queue_drain(client);
+    }
+
     /* software timer background processing */
     MultiTimerYield();
 
+    /* Sleep until the next timer or network event, a pending state change runs right away */
+    if (wait_ms && client->nextstate == client->state)
+    {
+        uint32_t timer_ms = MultiTimerNextTimeout();
+        tuya_mqtt_wait(&client->mqctx, timer_ms < wait_ms ? timer_ms : wait_ms);
+    }
+
     return ret;
 }
 
@@ -817,6 +1120,10 @@ int tuya_iot_activated_data_remove(tuya_iot_client_t *client)
     }
 
     /* Clean client local data */
+    char schema_key[MAX_LENGTH_UUID + 8];
+    snprintf(schema_key, sizeof schema_key, "%s.schema", client->config.storage_namespace);
+    local_storage_del(schema_key);
+    tuya_dp_schema_free(&client->dp_schema);
     local_storage_del((const char *)(client->activate.schemaId));
     local_storage_del((const char *)(client->config.storage_namespace));
     tuya_endpoint_remove();
@@ -833,7 +1140,61 @@ int tuya_iot_activated_data_remove(tuya_iot_client_t *client)
     return OPRT_OK;
 }
 
-static int tuya_iot_dp_report_json_common(tuya_iot_client_t *client, const char *dps, const char *time, tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms, bool async)
+typedef struct
+{
+    tuya_iot_client_t *client;
+    const char *dps;
+    const char *time;
+    const tuya_dp_t *values;
+    size_t count;
+    const tuya_dp_marks_t *marks;
+} dp_report_data_t;
+
+/* {"devId":"..","dps":{..},"t":{..}}, with the dps from JSON, values or the schema table */
+static int dp_report_data_write(json_writer_t *writer, void *user_data)
+{
+    const dp_report_data_t *report = (const dp_report_data_t *)user_data;
+    tuya_iot_client_t *client = report->client;
+    int rt = OPRT_OK;
+
+    json_writer_literal(writer, "{\"devId\":");
+    json_writer_string(writer, client->activate.devid, strlen(client->activate.devid));
+    json_writer_literal(writer, ",\"dps\":");
+    if (report->dps)
+    {
+        json_writer_literal(writer, report->dps);
+    }
+    else if (report->values)
+    {
+        rt = tuya_dp_schema_values_serialize(&client->dp_schema, writer, report->values, report->count);
+    }
+    else
+    {
+        rt = tuya_dp_schema_serialize(&client->dp_schema, report->marks, writer);
+    }
+    if (report->time)
+    {
+        json_writer_literal(writer, ",\"t\":");
+        json_writer_literal(writer, report->time);
+    }
+    json_writer_raw(writer, "}", 1);
+    return rt;
+}
+#define DP_REPORT_ENVELOPE_LENGTH (MAX_LENGTH_DEVICE_ID + sizeof("{\"devId\":\"\",\"dps\":,\"t\":}"))
+
+static int tuya_iot_dp_report_json_publish(tuya_iot_client_t *client, const char *dps, const char *time, tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms)
+{
+    dp_report_data_t report = {.client = client, .dps = dps, .time = time};
+    size_t length = DP_REPORT_ENVELOPE_LENGTH + strlen(dps) + (time ? strlen(time) : 0);
+
+    /* Written once, straight into the packet buffer */
+    return tuya_mqtt_protocol_data_write_common(&client->mqctx, PRO_DATA_PUSH, length,
+                                                dp_report_data_write, &report,
+                                                (mqtt_publish_notify_cb_t)cb, user_data,
+                                                timeout_ms);
+}
+
+static int tuya_iot_dp_report_json_common(tuya_iot_client_t *client, const char *dps, const char *time, tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms)
 {
     if (client == NULL || dps == NULL)
     {
@@ -841,46 +1202,55 @@ static int tuya_iot_dp_report_json_common(tuya_iot_client_t *client, const char
         return OPRT_INVALID_PARM;
     }
 
-    int ret;
-    int printlen = 0;
-    char *buffer = NULL;
+    /* Timed reports carry their own "t" and go out on their own */
+    if (client->config.dp_report_window_ms == 0 || time)
+    {
+        return tuya_iot_dp_report_json_publish(client, dps, time, cb, user_data, timeout_ms);
+    }
 
-    /* Package JSON format */
-    if (time)
+    if (tuya_mqtt_connected(&client->mqctx) == false)
     {
-        buffer = system_malloc(strlen(dps) + strlen(time) + 64);
-        TUYA_CHECK_NULL_RETURN(buffer, OPRT_MALLOC_FAILED);
-        printlen = sprintf(buffer, "{\"devId\":\"%s\",\"dps\":%s,\"t\":%s}", client->activate.devid, dps, time);
+        return OPRT_COM_ERROR;
     }
-    else
+
+    size_t len = strlen(dps);
+    struct tuya_dp_report *report = system_malloc(sizeof(struct tuya_dp_report) + len + 1);
+    TUYA_CHECK_NULL_RETURN(report, OPRT_MALLOC_FAILED);
+    report->next = NULL;
+    report->cb = cb;
+    report->user_data = user_data;
+    report->timeout_ms = timeout_ms;
+    memcpy(report->dps, dps, len + 1);
+
+    if (mpsc_ring_push(&client->dp_report_queue, report) != OPRT_OK)
     {
-        buffer = system_malloc(strlen(dps) + 64);
-        TUYA_CHECK_NULL_RETURN(buffer, OPRT_MALLOC_FAILED);
-        printlen = sprintf(buffer, "{\"devId\":\"%s\",\"dps\":%s}", client->activate.devid, dps);
+        TY_LOGW("dp report queue full");
+        system_free(report);
+        return OPRT_EXCEED_UPPER_LIMIT;
     }
 
-    /* Report buffer */
-    ret = tuya_mqtt_protocol_data_publish_common(&client->mqctx, PRO_DATA_PUSH,
-                                                 (const uint8_t *)buffer, (uint16_t)printlen,
-                                                 (mqtt_publish_notify_cb_t)cb, user_data,
-                                                 timeout_ms, async);
-    system_free(buffer);
-    return ret;
+    /* The loop may be asleep in tuya_mqtt_wait */
+    network_wakeup();
+    return OPRT_OK;
 }
 
 int tuya_iot_dp_report_json_async(tuya_iot_client_t *client, const char *dps, const char *time, tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms)
 {
-    return tuya_iot_dp_report_json_common(client, dps, time, cb, user_data, timeout_ms, true);
+    if (cb == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+    return tuya_iot_dp_report_json_common(client, dps, time, cb, user_data, timeout_ms);
 }
 
 int tuya_iot_dp_report_json_with_notify(tuya_iot_client_t *client, const char *dps, const char *time, tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms)
 {
-    return tuya_iot_dp_report_json_common(client, dps, time, cb, user_data, timeout_ms, false);
+    return tuya_iot_dp_report_json_common(client, dps, time, cb, user_data, timeout_ms);
 }
 
 int tuya_iot_dp_report_json_with_time(tuya_iot_client_t *client, const char *dps, const char *time)
 {
-    return tuya_iot_dp_report_json_common(client, dps, time, NULL, NULL, 0, false);
+    return tuya_iot_dp_report_json_common(client, dps, time, NULL, NULL, 0);
 }
 
 int tuya_iot_dp_report_json(tuya_iot_client_t *client, const char *dps)
@@ -888,6 +1258,112 @@ int tuya_iot_dp_report_json(tuya_iot_client_t *client, const char *dps)
     return tuya_iot_dp_report_json_with_time(client, dps, NULL);
 }
 
+static int tuya_iot_dp_set(tuya_iot_client_t *client, const tuya_dp_t *dp)
+{
+    if (client == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+    if (!tuya_dp_schema_loaded(&client->dp_schema))
+    {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+    return tuya_dp_schema_set(&client->dp_schema, dp);
+}
+
+int tuya_iot_dp_set_bool(tuya_iot_client_t *client, uint8_t id, bool value)
+{
+    tuya_dp_t dp = {.id = id, .type = TUYA_DP_TYPE_BOOL, .value.asBool = value};
+    return tuya_iot_dp_set(client, &dp);
+}
+
+int tuya_iot_dp_set_int(tuya_iot_client_t *client, uint8_t id, int32_t value)
+{
+    tuya_dp_t dp = {.id = id, .type = TUYA_DP_TYPE_VALUE, .value.asValue = value};
+    return tuya_iot_dp_set(client, &dp);
+}
+
+int tuya_iot_dp_set_enum(tuya_iot_client_t *client, uint8_t id, uint32_t value)
+{
+    tuya_dp_t dp = {.id = id, .type = TUYA_DP_TYPE_ENUM, .value.asEnum = value};
+    return tuya_iot_dp_set(client, &dp);
+}
+
+int tuya_iot_dp_set_bitmap(tuya_iot_client_t *client, uint8_t id, uint32_t value)
+{
+    tuya_dp_t dp = {.id = id, .type = TUYA_DP_TYPE_BITMAP, .value.asBitmap = value};
+    return tuya_iot_dp_set(client, &dp);
+}
+
+bool tuya_iot_dp_get_bool(tuya_iot_client_t *client, uint8_t id)
+{
+    tuya_dp_t dp;
+    if (client == NULL || tuya_dp_schema_get(&client->dp_schema, id, &dp) != OPRT_OK || dp.type != TUYA_DP_TYPE_BOOL)
+    {
+        return false;
+    }
+    return dp.value.asBool;
+}
+
+int32_t tuya_iot_dp_get_int(tuya_iot_client_t *client, uint8_t id)
+{
+    tuya_dp_t dp;
+    if (client == NULL || tuya_dp_schema_get(&client->dp_schema, id, &dp) != OPRT_OK || dp.type == TUYA_DP_TYPE_BOOL)
+    {
+        return 0;
+    }
+
+    /* Enum and bitmap values share the integer slot */
+    return dp.value.asValue;
+}
+
+int tuya_iot_dp_report(tuya_iot_client_t *client)
+{
+    if (client == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+    if (!tuya_dp_schema_loaded(&client->dp_schema))
+    {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+
+    /* Taken up front, a DP set while this report is written is marked again for the next one */
+    tuya_dp_marks_t marks;
+    tuya_dp_schema_dirty_take(&client->dp_schema, &marks);
+    size_t length = tuya_dp_schema_serialize_bound(&client->dp_schema, &marks);
+    if (length <= sizeof("{}") - 1)
+    {
+        return OPRT_OK;
+    }
+
+    dp_report_data_t report = {.client = client, .marks = &marks};
+    int rt = tuya_mqtt_protocol_data_write_common(&client->mqctx, PRO_DATA_PUSH, DP_REPORT_ENVELOPE_LENGTH + length,
+                                                  dp_report_data_write, &report,
+                                                  NULL, NULL, 0);
+
+    /* DPs stay marked for the next report if this one was not sent */
+    if (rt != OPRT_OK)
+    {
+        tuya_dp_schema_dirty_restore(&client->dp_schema, &marks);
+    }
+    return rt;
+}
+
+int tuya_iot_dp_report_values(tuya_iot_client_t *client, const tuya_dp_t *dps, size_t count)
+{
+    if (client == NULL || dps == NULL || count == 0)
+    {
+        return OPRT_INVALID_PARM;
+    }
+
+    dp_report_data_t report = {.client = client, .values = dps, .count = count};
+    size_t length = tuya_dp_schema_values_bound(&client->dp_schema, dps, count);
+    return tuya_mqtt_protocol_data_write_common(&client->mqctx, PRO_DATA_PUSH, DP_REPORT_ENVELOPE_LENGTH + length,
+                                                dp_report_data_write, &report,
+                                                NULL, NULL, 0);
+}
+
 int tuya_iot_token_get_port_register(tuya_iot_client_t *client, tuya_activate_token_get_t token_get_func)
 {
     if (client == NULL || token_get_func == NULL)
@@ -1,7 +1,10 @@
 #include <stdint.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include "tuya_log.h"
 #include "tuya_iot.h"
 #include "tuya_ota.h"
@@ -9,9 +12,205 @@
 #include "tuya_error_code.h"
 #include "system_interface.h"
 #include "file_download.h"
+#include "ota_interface.h"
+#include "storage_interface.h"
+#include "crc32.h"
+#include "tuya_endpoint.h"
+#include "mbedtls/version.h"
+#include "lzss_decoder.h"
+
+/* mbedTLS 2.x spells the int-returning SHA-256 calls with a _ret suffix */
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+#define mbedtls_sha256_starts   mbedtls_sha256_starts_ret
+#define mbedtls_sha256_update   mbedtls_sha256_update_ret
+#define mbedtls_sha256_finish   mbedtls_sha256_finish_ret
+#endif
 
 #define DEFAULT_DOWNLOAD_TIMEOUT     5000
 #define DEFAULT_DOWNLOAD_RANGESIZE   1024
+#define DEFAULT_DOWNLOAD_WINDOWSIZE  4
+
+#define OTA_CHECKPOINT_KEY           "ota_ckpt"
+#define OTA_CHECKPOINT_INTERVAL      (64 * 1024)
+
+static void tuya_ota_digest_hex(const uint8_t* digest, size_t len, char* hex)
+{
+    size_t i;
+    for (i = 0; i < len; i++) {
+        sprintf(hex + i * 2, "%02x", digest[i]);
+    }
+}
+
+static int tuya_ota_digest_verify(tuya_ota_handle_t* handle)
+{
+    uint8_t digest[32];
+    char hex[65];
+
+    if (handle->md5[0]) {
+        uni_md5_final(&handle->md5_ctx, digest);
+        tuya_ota_digest_hex(digest, 16, hex);
+        if (strcasecmp(hex, handle->md5) != 0) {
+            TY_LOGE("md5 mismatch:%s", hex);
+            return OPRT_COM_ERROR;
+        }
+    }
+
+    if (handle->sha256[0]) {
+        mbedtls_sha256_finish(&handle->sha256_ctx, digest);
+        tuya_ota_digest_hex(digest, 32, hex);
+        if (strcasecmp(hex, handle->sha256) != 0) {
+            TY_LOGE("sha256 mismatch:%s", hex);
+            return OPRT_COM_ERROR;
+        }
+    }
+    return OPRT_OK;
+}
+
+static size_t tuya_ota_checkpoint_restore(tuya_ota_handle_t* handle, size_t file_size)
+{
+    tuya_ota_checkpoint_t* checkpoint = &handle->checkpoint;
+    size_t len = sizeof(tuya_ota_checkpoint_t);
+
+    if (local_storage_get(OTA_CHECKPOINT_KEY, (uint8_t*)checkpoint, &len) != OPRT_OK ||
+        len != sizeof(tuya_ota_checkpoint_t) ||
+        checkpoint->identity != handle->checkpoint_identity ||
+        checkpoint->offset > file_size) {
+        return 0;
+    }
+
+#if defined(MBEDTLS_SHA256_ALT)
+    /* Accelerated SHA-256 keeps its state in hardware, it can't be restored */
+    if (handle->sha256[0]) {
+        return 0;
+    }
+#else
+    mbedtls_sha256_clone(&handle->sha256_ctx, &checkpoint->sha256_ctx);
+#endif
+    handle->md5_ctx = checkpoint->md5_ctx;
+
+    TY_LOGI("resume download from %" PRIu32, checkpoint->offset);
+    return checkpoint->offset;
+}
+
+static void tuya_ota_checkpoint_save(tuya_ota_handle_t* handle)
+{
+    /* Only what the sink has really stored may be skipped on resume */
+    if (ota_sink_sync(handle->sink) != OPRT_OK) {
+        return;
+    }
+    handle->checkpoint.identity = handle->checkpoint_identity;
+    local_storage_set(OTA_CHECKPOINT_KEY, (const uint8_t*)&handle->checkpoint, sizeof(tuya_ota_checkpoint_t));
+    TY_LOGD("checkpoint at %" PRIu32, handle->checkpoint.offset);
+}
+
+static void tuya_ota_digest_update(tuya_ota_handle_t* handle, const uint8_t* data, size_t len)
+{
+    if (handle->md5[0]) {
+        uni_md5_update(&handle->md5_ctx, data, len);
+    }
+    if (handle->sha256[0]) {
+        mbedtls_sha256_update(&handle->sha256_ctx, data, len);
+    }
+}
+
+/* The patch header carries the size of the rebuilt image, the sink opens on its first bytes */
+static int tuya_ota_delta_output(const uint8_t* data, size_t len, void* user_data)
+{
+    tuya_ota_handle_t* handle = (tuya_ota_handle_t*)user_data;
+
+    if (handle->sink == NULL) {
+        int rt = ota_sink_begin(handle->patch.image_size, 0, &handle->sink);
+        if (rt != OPRT_OK) {
+            return rt;
+        }
+    }
+    return ota_sink_write(handle->sink, data, len);
+}
+
+static int tuya_ota_patch_write(tuya_ota_handle_t* handle, const uint8_t* data, size_t len)
+{
+    if (handle->delta) {
+        return ota_delta_feed(&handle->patch, data, len);
+    }
+    return ota_sink_write(handle->sink, data, len);
+}
+
+static int tuya_ota_decoder_output(const uint8_t* data, size_t len, void* user_data)
+{
+    return tuya_ota_patch_write((tuya_ota_handle_t*)user_data, data, len);
+}
+
+static int tuya_ota_lzss_begin(tuya_ota_handle_t* handle)
+{
+    tuya_ota_lzss_header_t* header = &handle->header;
+    int rt;
+
+    if (memcmp(header->magic, TUYA_OTA_LZSS_MAGIC, sizeof(header->magic)) != 0) {
+        TY_LOGE("not a compressed image");
+        return OPRT_INVALID_PARM;
+    }
+
+    handle->image_size = header->image_size[0] | header->image_size[1] << 8 |
+                         header->image_size[2] << 16 | (uint32_t)header->image_size[3] << 24;
+    TY_LOGI("compressed image, window:%d, lookahead:%d, size:%d",
+            header->window_sz2, header->lookahead_sz2, handle->image_size);
+
+    rt = lzss_decoder_init(&handle->decoder, header->window_sz2, header->lookahead_sz2);
+    if (rt != OPRT_OK || handle->delta) {
+        return rt;
+    }
+    return ota_sink_begin(handle->image_size, 0, &handle->sink);
+}
+
+/* Downloaded data is decompressed, then patched, the sink only sees the firmware */
+static int tuya_ota_image_write(tuya_ota_handle_t* handle, const uint8_t* data, size_t len)
+{
+    if (!handle->compressed) {
+        return tuya_ota_patch_write(handle, data, len);
+    }
+
+    if (handle->header_len < TUYA_OTA_LZSS_HEADER_LEN) {
+        size_t copy = TUYA_OTA_LZSS_HEADER_LEN - handle->header_len;
+        copy = copy > len ? len : copy;
+        memcpy((uint8_t*)&handle->header + handle->header_len, data, copy);
+        handle->header_len += copy;
+        data += copy;
+        len -= copy;
+        if (handle->header_len < TUYA_OTA_LZSS_HEADER_LEN) {
+            return OPRT_OK;
+        }
+
+        int rt = tuya_ota_lzss_begin(handle);
+        if (rt != OPRT_OK) {
+            return rt;
+        }
+    }
+
+    int rt = lzss_decoder_feed(&handle->decoder, data, len, tuya_ota_decoder_output, handle);
+    if (rt == OPRT_OK && handle->decoder.total > handle->image_size) {
+        TY_LOGE("decompressed over image size");
+        rt = OPRT_EXCEED_UPPER_LIMIT;
+    }
+    return rt;
+}
+
+static void tuya_ota_fault(tuya_ota_handle_t* handle, int status)
+{
+    handle->running = false;
+    file_download_stop(&handle->file_download);
+    file_download_free(&handle->file_download);
+    if (handle->sink) {
+        ota_sink_abort(handle->sink);
+        handle->sink = NULL;
+    }
+    lzss_decoder_free(&handle->decoder);
+    ota_delta_free(&handle->patch);
+    mbedtls_sha256_free(&handle->sha256_ctx);
+
+    handle->event.id = TUYA_OTA_EVENT_FAULT;
+    handle->config.event_cb(handle, &handle->event);
+    tuya_ota_upgrade_status_report(handle, status);
+}
 
 static void file_download_event_cb(file_download_context_t* ctx, file_download_event_t* event)
 {
@@ -26,6 +225,14 @@ static void file_download_event_cb(file_download_context_t* ctx, file_download_e
 
     case DL_EVENT_ON_FILESIZE:
         TY_LOGD("DL_EVENT_ON_FILESIZE");
+        /* A compressed or delta image opens the sink once its header is in */
+        if (ota_handle->config.sink_enable && !ota_handle->compressed && !ota_handle->delta &&
+            ota_sink_begin(event->file_size, ctx->received_size, &ota_handle->sink) != OPRT_OK) {
+            TY_LOGE("ota sink begin error");
+            tuya_ota_fault(ota_handle, TUS_DOWNLOAD_ERROR_STORAGE_NOT_ENOUGH);
+            break;
+        }
+
         ota_handle->event.id = TUYA_OTA_EVENT_START;
         ota_handle->event.file_size = event->file_size;
         ota_handle->event.user_data = ota_handle->config.user_data;
@@ -34,15 +241,48 @@ static void file_download_event_cb(file_download_context_t* ctx, file_download_e
 
     case DL_EVENT_ON_DATA:{
         TY_LOGD("DL_EVENT_ON_DATA:%d", event->data_len);
+        size_t boundary = (event->offset / OTA_CHECKPOINT_INTERVAL + 1) * OTA_CHECKPOINT_INTERVAL;
+        bool checkpoint = ota_handle->sink && !ota_handle->compressed && !ota_handle->delta &&
+                          event->offset + event->data_len >= boundary;
+
+        if (checkpoint) {
+            /* Snapshot the digests exactly at the checkpoint boundary */
+            size_t split = boundary - event->offset;
+            tuya_ota_digest_update(ota_handle, event->data, split);
+            ota_handle->checkpoint.offset = boundary;
+            ota_handle->checkpoint.md5_ctx = ota_handle->md5_ctx;
+#if !defined(MBEDTLS_SHA256_ALT)
+            mbedtls_sha256_clone(&ota_handle->checkpoint.sha256_ctx, &ota_handle->sha256_ctx);
+#endif
+            tuya_ota_digest_update(ota_handle, (const uint8_t*)event->data + split, event->data_len - split);
+        } else {
+            tuya_ota_digest_update(ota_handle, event->data, event->data_len);
+        }
+
+        /* Flash writes complete in the sink's own time, this only queues the data */
+        if (ota_handle->config.sink_enable &&
+            tuya_ota_image_write(ota_handle, event->data, event->data_len) != OPRT_OK) {
+            TY_LOGE("ota sink write error");
+            local_storage_del(OTA_CHECKPOINT_KEY);
+            tuya_ota_fault(ota_handle, TUS_UPGRD_EXEC);
+            break;
+        }
+
+        if (checkpoint) {
+            tuya_ota_checkpoint_save(ota_handle);
+        }
+
         ota_handle->event.id = TUYA_OTA_EVENT_ON_DATA;
         ota_handle->event.data = event->data;
         ota_handle->event.data_len = event->data_len;
         ota_handle->event.offset = event->offset;
+        ota_handle->event.range_size = event->range_length;
+        ota_handle->event.rate = event->rate;
         event_cb(ota_handle, &ota_handle->event);
         event->offset = ota_handle->event.offset;
 
         uint8_t percent = ota_handle->file_download.received_size * 100 / ota_handle->file_download.file_size;
-        TY_LOGD("File Download Percent: %d%%", percent);
+        TY_LOGD("File Download Percent: %d%%, range:%d, %" PRIu32 " B/s", percent, event->range_length, event->rate);
         if (percent - ota_handle->progress_percent > 2) {
             tuya_ota_upgrade_progress_report(ota_handle, percent);
             ota_handle->progress_percent = percent;
@@ -50,20 +290,54 @@ static void file_download_event_cb(file_download_context_t* ctx, file_download_e
         break;
     }
 
-    case DL_EVENT_FINISH:
+    case DL_EVENT_FINISH:{
         TY_LOGD("DL_EVENT_FINISH");
+        local_storage_del(OTA_CHECKPOINT_KEY);
+        if (tuya_ota_digest_verify(ota_handle) != OPRT_OK) {
+            tuya_ota_fault(ota_handle, TUS_DOWNLOAD_ERROR_HMAC);
+            break;
+        }
+        mbedtls_sha256_free(&ota_handle->sha256_ctx);
+
+        if (ota_handle->compressed && ota_handle->config.sink_enable &&
+            (ota_handle->sink == NULL || ota_handle->decoder.total != ota_handle->image_size)) {
+            TY_LOGE("decompressed %d of %d bytes", ota_handle->decoder.total, ota_handle->image_size);
+            tuya_ota_fault(ota_handle, TUS_UPGRADE_ERROR_HMAC);
+            break;
+        }
+        lzss_decoder_free(&ota_handle->decoder);
+
+        if (ota_handle->delta && ota_handle->config.sink_enable &&
+            (ota_handle->sink == NULL || ota_handle->patch.total != ota_handle->patch.image_size)) {
+            TY_LOGE("patched %d of %d bytes", ota_handle->patch.total, ota_handle->patch.image_size);
+            tuya_ota_fault(ota_handle, TUS_UPGRADE_ERROR_HMAC);
+            break;
+        }
+        ota_delta_free(&ota_handle->patch);
+
+        if (ota_handle->sink) {
+            int ret = ota_sink_finish(ota_handle->sink);
+            ota_handle->sink = NULL;
+            if (ret != OPRT_OK) {
+                TY_LOGE("ota sink finish error:%d", ret);
+                tuya_ota_fault(ota_handle, TUS_UPGRADE_ERROR_HMAC);
+                break;
+            }
+        }
+
+        ota_handle->running = false;
+        file_download_free(ctx);
         TY_LOGD("File Download Percent: %d%%", 100);
         tuya_ota_upgrade_progress_report(ota_handle, 100);
         ota_handle->event.id = TUYA_OTA_EVENT_FINISH;
         event_cb(ota_handle, &ota_handle->event);
         tuya_ota_upgrade_status_report(ota_handle, TUS_UPGRD_FINI);
         break;
+    }
 
     case DL_EVENT_FAULT:
         TY_LOGD("DL_EVENT_FAULT");
-        ota_handle->event.id = TUYA_OTA_EVENT_FAULT;
-        event_cb(ota_handle, &ota_handle->event);
-        tuya_ota_upgrade_status_report(ota_handle, TUS_UPGRD_EXEC);
+        tuya_ota_fault(ota_handle, TUS_UPGRD_EXEC);
         break;
 
     default:
@@ -84,18 +358,89 @@ int tuya_ota_begin(tuya_ota_handle_t* handle, cJSON* upgrade)
 
     tuya_iot_client_t* client = handle->config.client;
 
+    /* Re-initialising would drop the armed timers and open a second sink */
+    if (handle->running) {
+        TY_LOGW("ota already running, notification ignored");
+        return OPRT_COM_ERROR;
+    }
+
+    cJSON* type = cJSON_GetObjectItem(upgrade, "type");
+    cJSON* size = cJSON_GetObjectItem(upgrade, "size");
+    cJSON* url = cJSON_GetObjectItem(upgrade, "url");
+    if (!cJSON_IsNumber(type) || !cJSON_IsString(size) || !cJSON_IsString(url)) {
+        TY_LOGE("upgrade info incomplete");
+        return OPRT_CJSON_GET_ERR;
+    }
+
     file_download_context_t* file_download = &handle->file_download;
-    handle->channel = cJSON_GetObjectItem(upgrade, "type")->valueint;
+    handle->channel = type->valueint;
+
+    /* Digests are checked as the data streams, only the ones the cloud sent */
+    cJSON* digest = cJSON_GetObjectItem(upgrade, "md5");
+    snprintf(handle->md5, sizeof(handle->md5), "%s", cJSON_IsString(digest) ? digest->valuestring : "");
+    digest = cJSON_GetObjectItem(upgrade, "sha256");
+    snprintf(handle->sha256, sizeof(handle->sha256), "%s", cJSON_IsString(digest) ? digest->valuestring : "");
+    uni_md5_init(&handle->md5_ctx);
+    mbedtls_sha256_init(&handle->sha256_ctx);
+    mbedtls_sha256_starts(&handle->sha256_ctx, 0);
+
+    /* The URL is signed per notification, identify the image by what it contains. The
+     * hash contexts are saved as raw bytes, so a build that lays them out differently
+     * must not pick the checkpoint up: their sizes and the mbedTLS version go in too. */
+    size_t file_size = atol(size->valuestring);
+    cJSON* version = cJSON_GetObjectItem(upgrade, "version");
+    char identity[192];
+    int identity_len = snprintf(identity, sizeof(identity), "%s,%d,%s,%s,%d,%d,%lx",
+                                cJSON_IsString(version) ? version->valuestring : "",
+                                (int)file_size, handle->md5, handle->sha256,
+                                (int)sizeof(UNI_MD5_CTX_S), (int)sizeof(tuya_ota_checkpoint_t),
+                                (unsigned long)MBEDTLS_VERSION_NUMBER);
+    if (identity_len >= (int)sizeof(identity)) {
+        identity_len = sizeof(identity) - 1;
+    }
+    handle->checkpoint_identity = crc_32((const uint8_t*)identity, identity_len);
+
+    /* The decoder window can't be checkpointed, compressed images always start over */
+    cJSON* compress = cJSON_GetObjectItem(upgrade, "compress");
+    handle->compressed = cJSON_IsString(compress) && strcmp(compress->valuestring, "lzss") == 0;
+    handle->header_len = 0;
+    handle->image_size = 0;
+    memset(&handle->decoder, 0, sizeof(lzss_decoder_t));
+
+    /* Patch state isn't checkpointed either */
+    handle->delta = cJSON_IsTrue(cJSON_GetObjectItem(upgrade, "delta"));
+    memset(&handle->patch, 0, sizeof(ota_delta_t));
+    if (handle->delta && handle->config.sink_enable &&
+        ota_delta_init(&handle->patch, tuya_ota_delta_output, handle) != OPRT_OK) {
+        mbedtls_sha256_free(&handle->sha256_ctx);
+        tuya_ota_upgrade_status_report(handle, TUS_DOWNLOAD_ERROR_MALLOC_FAIL);
+        return OPRT_MALLOC_FAILED;
+    }
+
+    size_t offset = 0;
+    if (handle->config.sink_enable && !handle->compressed && !handle->delta) {
+        offset = tuya_ota_checkpoint_restore(handle, file_size);
+    }
+
+    /* Fetched straight over HTTPS when the cloud offers it, MQTT ranges otherwise */
+    cJSON* https_url = cJSON_GetObjectItem(upgrade, "httpsUrl");
+    const tuya_endpoint_t* endpoint = tuya_endpoint_get();
     file_download_init(file_download, &(const file_download_config_t){
-        .url = cJSON_GetObjectItem(upgrade, "url")->valuestring,
-        .file_size = atol(cJSON_GetObjectItem(upgrade, "size")->valuestring),
+        .url = url->valuestring,
+        .https_url = cJSON_IsString(https_url) ? https_url->valuestring : NULL,
+        .cacert = endpoint->atop.cert,
+        .cacert_len = endpoint->atop.cert_len,
+        .file_size = file_size,
+        .offset = offset,
         .timeout_ms = handle->config.timeout_ms ? handle->config.timeout_ms:DEFAULT_DOWNLOAD_TIMEOUT,
         .range_length = handle->config.range_size ? handle->config.range_size:DEFAULT_DOWNLOAD_RANGESIZE,
+        .window_size = handle->config.window_size ? handle->config.window_size:DEFAULT_DOWNLOAD_WINDOWSIZE,
         .transport = &client->matop,
         .event_handler = file_download_event_cb,
         .user_data = handle,
     });
 
+    handle->running = true;
     file_download_start(file_download);
 
     return ret;
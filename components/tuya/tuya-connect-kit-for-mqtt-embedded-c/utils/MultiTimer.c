@@ -1,17 +1,79 @@
 #include "MultiTimer.h"
 #include <stdio.h>
+#include <stdlib.h>
 
-#define MULTIMER_MAX_TIMEOUT  0x7fffffff
+#define MULTIMER_HEAP_MIN  16
 
-/* Check if timer's expiry time is greater than time and care about uint32_t wraparounds */
-#define CHECK_TIME_LESS_THAN(t, compare_to) ( (((uint32_t)((t)-(compare_to))) > MULTIMER_MAX_TIMEOUT) ? 1 : 0 )
+/* Check if time a is before b and care about uint32_t wraparounds */
+#define CHECK_TIME_BEFORE(a, b) ( ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0) ? 1 : 0 )
 
-/* Timer handle list head. */
-static MultiTimer* timerList = NULL;
+/* Binary min-heap of active timers ordered by deadline, the earliest at [0]. */
+static MultiTimer** timerHeap = NULL;
+static uint32_t timerCount = 0;
+static uint32_t timerCapacity = 0;
 
 /* Timer tick */
 static PlatformTicksFunction_t platformTicksFunction = NULL;
 
+/* Expiry time of the running MultiTimerYield pass, timers started from callbacks wait for the next pass */
+static bool yielding = false;
+static uint32_t yieldTicks = 0;
+
+static void heapPlace(uint32_t i, MultiTimer* timer)
+{
+    timerHeap[i] = timer;
+    timer->index = i + 1;
+}
+
+static void heapSiftUp(uint32_t i)
+{
+    MultiTimer* timer = timerHeap[i];
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (!CHECK_TIME_BEFORE(timer->deadline, timerHeap[parent]->deadline)) {
+            break;
+        }
+        heapPlace(i, timerHeap[parent]);
+        i = parent;
+    }
+    heapPlace(i, timer);
+}
+
+static void heapSiftDown(uint32_t i)
+{
+    MultiTimer* timer = timerHeap[i];
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= timerCount) {
+            break;
+        }
+        if (child + 1 < timerCount &&
+            CHECK_TIME_BEFORE(timerHeap[child + 1]->deadline, timerHeap[child]->deadline)) {
+            child++;
+        }
+        if (!CHECK_TIME_BEFORE(timerHeap[child]->deadline, timer->deadline)) {
+            break;
+        }
+        heapPlace(i, timerHeap[child]);
+        i = child;
+    }
+    heapPlace(i, timer);
+}
+
+static void heapRemove(MultiTimer* timer)
+{
+    uint32_t i = timer->index - 1;
+    MultiTimer* last = timerHeap[--timerCount];
+
+    timer->index = 0;
+    if (last == timer) {
+        return;
+    }
+    heapPlace(i, last);
+    heapSiftUp(i);
+    heapSiftDown(last->index - 1);
+}
+
 /**
  * @brief 
  * 
@@ -46,36 +108,42 @@ int MultiTimerInit(MultiTimer* timer, uint32_t period, MultiTimerCallback_t cb,
   * @brief  Start the timer work, add the handle into work list.
   * @param  handle: target handle strcut.
   * @param  deadline: Set the start time.
-  * @retval 0: succeed. -1: already exist.
+  * @retval 0: succeed. -1: out of memory.
   */
 int MultiTimerStart(MultiTimer* timer, uint32_t startTime)
 {
-    MultiTimer** nextTimer = &timerList;
+    /* New deadline time. */
+    uint32_t deadline = platformTicksFunction() + startTime;
+    if (yielding && !CHECK_TIME_BEFORE(yieldTicks, deadline)) {
+        deadline = yieldTicks + 1;
+    }
 
-    /* Remove the existing target timer. */
-    for (; *nextTimer; nextTimer = &(*nextTimer)->next) {
-        if (timer == *nextTimer) {
-            *nextTimer = timer->next; /* remove from list */
-            break;
+    /* Restart in place. */
+    if (MultiTimerActivated(timer)) {
+        bool earlier = CHECK_TIME_BEFORE(deadline, timer->deadline);
+        timer->deadline = deadline;
+        if (earlier) {
+            heapSiftUp(timer->index - 1);
+        } else {
+            heapSiftDown(timer->index - 1);
         }
+        return 0;
     }
 
-    /* New deadline time. */
-    timer->deadline = platformTicksFunction() + startTime;
-
-    /* Insert timer. */
-    for (nextTimer = &timerList;; nextTimer = &(*nextTimer)->next) {
-        if (!*nextTimer) {
-            timer->next = NULL;
-            *nextTimer = timer;
-            break;
-        }
-        if (timer->deadline < (*nextTimer)->deadline) {
-            timer->next = *nextTimer;
-            *nextTimer = timer;
-            break;
+    if (timerCount == timerCapacity) {
+        uint32_t capacity = timerCapacity ? timerCapacity * 2 : MULTIMER_HEAP_MIN;
+        MultiTimer** heap = realloc(timerHeap, capacity * sizeof(MultiTimer*));
+        if (!heap) {
+            return -1;
         }
+        timerHeap = heap;
+        timerCapacity = capacity;
     }
+
+    /* Insert timer. */
+    timer->deadline = deadline;
+    heapPlace(timerCount++, timer);
+    heapSiftUp(timer->index - 1);
     return 0;
 }
 
@@ -86,15 +154,8 @@ int MultiTimerStart(MultiTimer* timer, uint32_t startTime)
   */
 int MultiTimerStop(MultiTimer* timer)
 {
-    MultiTimer** nextTimer = &timerList;
-
-    /* Find and remove timer. */
-    for (; *nextTimer; nextTimer = &(*nextTimer)->next) {
-        MultiTimer* entry = *nextTimer;
-        if (entry == timer) {
-            *nextTimer = timer->next;
-            break;
-        }
+    if (MultiTimerActivated(timer)) {
+        heapRemove(timer);
     }
     return 0;
 }
@@ -108,14 +169,8 @@ int MultiTimerStop(MultiTimer* timer)
  */
 bool MultiTimerActivated(MultiTimer* timer)
 {
-    MultiTimer* entry = timerList;
-    while (entry) {
-        if (entry == timer) {
-            return true;
-        }
-        entry = entry->next;
-    }
-    return false;
+    /* Stale or uninitialised indexes never point back at the timer */
+    return timer->index && timer->index <= timerCount && timerHeap[timer->index - 1] == timer;
 }
 
 /**
@@ -125,16 +180,13 @@ bool MultiTimerActivated(MultiTimer* timer)
   */
 void MultiTimerYield(void)
 {
-    MultiTimer** nextTimer = &timerList;
+    /* One tick read for the whole pass, expired timers are taken off the top in deadline order. */
+    yieldTicks = platformTicksFunction();
+    yielding = true;
 
-    for (; *nextTimer; nextTimer = &(*nextTimer)->next) {
-        MultiTimer* entry = *nextTimer;
-        /* Sorted list, just process with the front part. */
-        if (CHECK_TIME_LESS_THAN(platformTicksFunction(), entry->deadline)) {
-            return;
-        }
-        /* remove expired timer from list */
-        *nextTimer = entry->next;
+    while (timerCount && !CHECK_TIME_BEFORE(yieldTicks, timerHeap[0]->deadline)) {
+        MultiTimer* entry = timerHeap[0];
+        heapRemove(entry);
 
         if (entry->period) {
             MultiTimerStart(entry, entry->period);
@@ -142,8 +194,25 @@ void MultiTimerYield(void)
         if (entry->callback) {
             entry->callback(entry, entry->userData);
         }
-        if (entry->next == NULL) {
-            return;
-        }
     }
+
+    yielding = false;
+}
+
+/**
+  * @brief  Time left until the next timer is due.
+  * @param  None.
+  * @retval Milliseconds, MULTITIMER_NO_TIMEOUT when no timer runs.
+  */
+uint32_t MultiTimerNextTimeout(void)
+{
+    if (!timerCount) {
+        return MULTITIMER_NO_TIMEOUT;
+    }
+
+    uint32_t now = platformTicksFunction();
+    if (!CHECK_TIME_BEFORE(now, timerHeap[0]->deadline)) {
+        return 0;
+    }
+    return timerHeap[0]->deadline - now;
 }
@@ -15,7 +15,7 @@ typedef struct MultiTimerHandle MultiTimer;
 typedef void (*MultiTimerCallback_t)(MultiTimer* timer, void* userData);
 
 struct MultiTimerHandle {
-    MultiTimer* next;
+    uint32_t index; /* heap slot + 1, 0 while stopped */
     uint32_t deadline;
     uint32_t period;
     MultiTimerCallback_t callback;
@@ -34,6 +34,11 @@ bool MultiTimerActivated(MultiTimer* timer);
 
 void MultiTimerYield(void);
 
+/* Milliseconds until the earliest timer expires, 0 if overdue, MULTITIMER_NO_TIMEOUT if none. */
+#define MULTITIMER_NO_TIMEOUT  0xFFFFFFFFU
+
+uint32_t MultiTimerNextTimeout(void);
+
 #ifdef __cplusplus
 } 
 #endif
@@ -2429,6 +2429,130 @@ OPERATE_RET aes128_cbc_decode_raw(IN CONST BYTE_T *data,IN CONST UINT_T len,\
 }
 
 
+/* AES-128 always expands to 10 rounds, 44 round key words */
+#define AES128_ROUNDS 10
+
+STATIC VOID __aes128_ctx_bind(ty_mbedtls_aes_context *aes, CONST uint32_t *rk)
+{
+    aes->nr = AES128_ROUNDS;
+    aes->rk = (uint32_t *)rk;
+}
+
+OPERATE_RET aes128_key_ctx_init(OUT AES128_KEY_CTX_S *ctx, IN CONST BYTE_T *key)
+{
+    if(NULL == ctx || NULL == key)
+        return OPRT_INVALID_PARM;
+
+    ty_mbedtls_aes_context aes;
+    memcpy(ctx->key, key, AES128_ENCRYPT_KEY_LEN);
+
+    ty_mbedtls_aes_init(&aes);
+    ty_mbedtls_aes_setkey_enc(&aes, key, 128);
+    memcpy(ctx->enc_rk, aes.rk, SIZEOF(ctx->enc_rk));
+    ty_mbedtls_aes_setkey_dec(&aes, key, 128);
+    memcpy(ctx->dec_rk, aes.rk, SIZEOF(ctx->dec_rk));
+    ty_mbedtls_aes_free(&aes);
+
+    return OPRT_OK;
+}
+
+VOID aes128_key_ctx_free(IN AES128_KEY_CTX_S *ctx)
+{
+    if(NULL == ctx)
+        return;
+
+    mbedtls_zeroize(ctx, SIZEOF(AES128_KEY_CTX_S));
+}
+
+OPERATE_RET aes128_ecb_encode_raw_ctx(IN CONST BYTE_T *data, IN CONST UINT_T len,\
+                                      OUT BYTE_T *ec_data,IN CONST AES128_KEY_CTX_S *ctx)
+{
+    if(NULL == data || NULL == ctx || NULL == ec_data || 0 == len)
+        return OPRT_INVALID_PARM;
+
+    if(len % 16 != 0)
+        return OPRT_INVALID_PARM;
+
+    if(s_aes_method.ecb_enc_128 != NULL) {
+        s_aes_method.ecb_enc_128(data, len, ctx->key, ec_data);
+    } else {
+        ty_mbedtls_aes_context aes;
+        __aes128_ctx_bind(&aes, ctx->enc_rk);
+
+        INT_T index = 0;
+        for(index = 0; index < len;index += 16)
+            ty_mbedtls_aes_crypt_ecb( &aes, MBEDTLS_AES_ENCRYPT, data+index, ec_data+index);
+    }
+
+    return OPRT_OK;
+}
+
+OPERATE_RET aes128_ecb_decode_raw_ctx(IN CONST BYTE_T *data, IN CONST UINT_T len,\
+                                      OUT BYTE_T *dec_data,IN CONST AES128_KEY_CTX_S *ctx)
+{
+    if(NULL == data || 0 == len || NULL == ctx || NULL == dec_data )
+        return OPRT_INVALID_PARM;
+
+    if(len % 16 != 0)
+        return OPRT_INVALID_PARM;
+
+    if(s_aes_method.ecb_dec_128 != NULL) {
+        s_aes_method.ecb_dec_128(data, len, ctx->key, dec_data);
+    } else {
+        ty_mbedtls_aes_context aes;
+        __aes128_ctx_bind(&aes, ctx->dec_rk);
+
+        INT_T index = 0;
+        for(index = 0; index < len;index += 16)
+            ty_mbedtls_aes_crypt_ecb( &aes, MBEDTLS_AES_DECRYPT, data+index, dec_data+index);
+    }
+
+    return OPRT_OK;
+}
+
+OPERATE_RET aes128_cbc_encode_raw_ctx(IN CONST BYTE_T *data,IN CONST UINT_T len,\
+                                      IN CONST AES128_KEY_CTX_S *ctx,IN BYTE_T *iv,\
+                                      OUT BYTE_T *ec_data)
+{
+    if(NULL == data || 0 == len || NULL == ctx || NULL == iv || NULL == ec_data)
+        return OPRT_INVALID_PARM;
+
+    if(len % 16 != 0)
+        return OPRT_INVALID_PARM;
+
+    if(s_aes_method.cbc_enc_128 != NULL) {
+        s_aes_method.cbc_enc_128(data, len, ctx->key, iv, ec_data);
+    } else {
+        ty_mbedtls_aes_context aes;
+        __aes128_ctx_bind(&aes, ctx->enc_rk);
+        ty_mbedtls_aes_crypt_cbc( &aes, MBEDTLS_AES_ENCRYPT, len, iv, data, ec_data);
+    }
+
+    return OPRT_OK;
+}
+
+OPERATE_RET aes128_cbc_decode_raw_ctx(IN CONST BYTE_T *data,IN CONST UINT_T len,\
+                                      IN CONST AES128_KEY_CTX_S *ctx,IN BYTE_T *iv,\
+                                      OUT BYTE_T *dec_data)
+{
+    if(NULL == data || 0 == len || NULL == ctx || NULL == iv || NULL == dec_data)
+        return OPRT_INVALID_PARM;
+
+    if(len % 16 != 0)
+        return OPRT_INVALID_PARM;
+
+    if(s_aes_method.cbc_dec_128 != NULL) {
+        s_aes_method.cbc_dec_128(data, len, ctx->key, iv, dec_data);
+    } else {
+        ty_mbedtls_aes_context aes;
+        __aes128_ctx_bind(&aes, ctx->dec_rk);
+        ty_mbedtls_aes_crypt_cbc( &aes, MBEDTLS_AES_DECRYPT, len, iv, data, dec_data);
+    }
+
+    return OPRT_OK;
+}
+
+
 OPERATE_RET aes192_cbc_encode_raw(IN CONST BYTE_T *data,IN CONST UINT_T len,\
                                   IN CONST BYTE_T *key,IN BYTE_T *iv,\
                                   OUT BYTE_T *ec_data)
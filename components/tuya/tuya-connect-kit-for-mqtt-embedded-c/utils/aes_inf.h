@@ -5,6 +5,7 @@ Copyright(C),2018-2020, 涂鸦科技 www.tuya.comm
 #ifndef _AES_INF_H_
 #define _AES_INF_H_
 
+#include <stdint.h>
 #include "tuya_error_code.h"
 #include "tuya_cloud_types.h"
 
@@ -145,6 +146,32 @@ OPERATE_RET aes128_cbc_decode_raw(IN const BYTE_T *data,IN const UINT_T len,\
                                   OUT BYTE_T *dec_data);
 
 
+/* AES-128 key with its expanded round keys, so the schedule is built once per key */
+typedef struct {
+    BYTE_T   key[AES128_ENCRYPT_KEY_LEN];
+    uint32_t enc_rk[44];
+    uint32_t dec_rk[44];
+} AES128_KEY_CTX_S;
+
+OPERATE_RET aes128_key_ctx_init(OUT AES128_KEY_CTX_S *ctx, IN const BYTE_T *key);
+
+VOID aes128_key_ctx_free(IN AES128_KEY_CTX_S *ctx);
+
+OPERATE_RET aes128_ecb_encode_raw_ctx(IN const BYTE_T *data, IN const UINT_T len,\
+                                      OUT BYTE_T *ec_data,IN const AES128_KEY_CTX_S *ctx);
+
+OPERATE_RET aes128_ecb_decode_raw_ctx(IN const BYTE_T *data, IN const UINT_T len,\
+                                      OUT BYTE_T *dec_data,IN const AES128_KEY_CTX_S *ctx);
+
+OPERATE_RET aes128_cbc_encode_raw_ctx(IN const BYTE_T *data,IN const UINT_T len,\
+                                      IN const AES128_KEY_CTX_S *ctx,IN BYTE_T *iv,\
+                                      OUT BYTE_T *ec_data);
+
+OPERATE_RET aes128_cbc_decode_raw_ctx(IN const BYTE_T *data,IN const UINT_T len,\
+                                      IN const AES128_KEY_CTX_S *ctx,IN BYTE_T *iv,\
+                                      OUT BYTE_T *dec_data);
+
+
 #define aes128_free_data                    aes_free_data
 #define aes128_get_data_actual_length       aes_get_actual_length
 
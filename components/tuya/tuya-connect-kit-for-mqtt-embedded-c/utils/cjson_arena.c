@@ -0,0 +1,100 @@
+#include <stdint.h>
+#include "cjson_arena.h"
+#include "cJSON.h"
+#include "tuya_error_code.h"
+#include "system_interface.h"
+
+#define CJSON_ARENA_ALIGN (sizeof(void*) * 2)
+
+typedef struct {
+    uint8_t* buffer;
+    size_t capacity;
+    size_t used;
+    size_t last;
+    uint32_t depth;
+    void* volatile owner;
+} cjson_arena_t;
+
+static cjson_arena_t arena;
+
+static void* cjson_arena_malloc(size_t size)
+{
+    if (arena.owner == NULL || arena.owner != system_thread_self()) {
+        return system_malloc(size);
+    }
+
+    size_t aligned = (size + CJSON_ARENA_ALIGN - 1) & ~(CJSON_ARENA_ALIGN - 1);
+    if (aligned > arena.capacity - arena.used) {
+        return system_malloc(size);
+    }
+
+    arena.last = arena.used;
+    arena.used += aligned;
+    return arena.buffer + arena.last;
+}
+
+static void cjson_arena_free(void* ptr)
+{
+    uint8_t* p = (uint8_t*)ptr;
+
+    if (p < arena.buffer || p >= arena.buffer + arena.capacity) {
+        system_free(ptr);
+        return;
+    }
+
+    /* Only the newest block can be handed back, the rest waits for end */
+    if (p == arena.buffer + arena.last && arena.owner == system_thread_self()) {
+        arena.used = arena.last;
+    }
+}
+
+int cjson_arena_init(size_t capacity)
+{
+    cJSON_Hooks hooks = {
+        .malloc_fn = system_malloc,
+        .free_fn = system_free};
+
+    if (arena.buffer) {
+        system_free(arena.buffer);
+        arena.buffer = NULL;
+    }
+    arena.capacity = capacity & ~(CJSON_ARENA_ALIGN - 1);
+    arena.buffer = arena.capacity ? system_malloc(arena.capacity) : NULL;
+    if (arena.buffer) {
+        hooks.malloc_fn = cjson_arena_malloc;
+        hooks.free_fn = cjson_arena_free;
+    }
+    cJSON_InitHooks(&hooks);
+
+    return arena.capacity && arena.buffer == NULL ? OPRT_MALLOC_FAILED : OPRT_OK;
+}
+
+void cjson_arena_begin(void)
+{
+    if (arena.buffer == NULL) {
+        return;
+    }
+
+    /* Another task's scope is open, this one stays on the heap */
+    if (arena.depth && arena.owner != system_thread_self()) {
+        return;
+    }
+
+    if (arena.depth++ == 0) {
+        arena.used = 0;
+        arena.last = 0;
+        arena.owner = system_thread_self();
+    }
+}
+
+void cjson_arena_end(void)
+{
+    if (arena.depth == 0 || arena.owner != system_thread_self()) {
+        return;
+    }
+
+    if (--arena.depth == 0) {
+        arena.owner = NULL;
+        arena.used = 0;
+    }
+}
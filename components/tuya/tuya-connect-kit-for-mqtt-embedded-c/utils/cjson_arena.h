@@ -0,0 +1,29 @@
+#ifndef _CJSON_ARENA_H_
+#define _CJSON_ARENA_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Bump allocator behind the cJSON hooks. Between begin and end, cJSON
+ * allocations of the task that called begin are carved from one fixed
+ * buffer, frees are no-ops and end releases everything at once. Other
+ * tasks, and allocations that do not fit, go to system_malloc as usual.
+ *
+ * Nothing cJSON allocates inside a scope may be kept after its end.
+ */
+int cjson_arena_init(size_t capacity);
+
+/* Called by one task at a time, scopes nest and only the outermost end releases the arena */
+void cjson_arena_begin(void);
+
+void cjson_arena_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -60,5 +60,8 @@
  */
 uint32_t		crc_32(             const unsigned char *input_str, size_t num_bytes       );
 uint32_t		update_crc_32(      uint32_t crc, unsigned char c                          );
+uint32_t		crc32_init(         void                                                   );
+uint32_t		crc32_update(       uint32_t crc, const unsigned char *input_str, size_t num_bytes );
+uint32_t		crc32_final(        uint32_t crc                                           );
 
 #endif  // DEF_LIBCRC_CHECKSUM_H
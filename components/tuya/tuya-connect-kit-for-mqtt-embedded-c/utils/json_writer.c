@@ -0,0 +1,140 @@
+#include <string.h>
+#include "json_writer.h"
+#include "tuya_error_code.h"
+
+static const char json_hex[] = "0123456789abcdef";
+static const char json_base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Reserves length bytes, NULL once the writer has overflowed */
+static char* json_writer_reserve(json_writer_t* writer, size_t length)
+{
+    if (writer->overflow || length > writer->size - writer->length) {
+        writer->overflow = true;
+        return NULL;
+    }
+    char* p = writer->buffer + writer->length;
+    writer->length += length;
+    return p;
+}
+
+void json_writer_init(json_writer_t* writer, char* buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size ? size - 1 : 0;
+    writer->length = 0;
+    writer->overflow = size == 0;
+}
+
+void json_writer_raw(json_writer_t* writer, const char* data, size_t length)
+{
+    char* p = json_writer_reserve(writer, length);
+    if (p) {
+        memcpy(p, data, length);
+    }
+}
+
+void json_writer_string(json_writer_t* writer, const char* str, size_t length)
+{
+    size_t i;
+    char* p;
+
+    json_writer_raw(writer, "\"", 1);
+    for (i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)str[i];
+        char escape = 0;
+
+        switch (c) {
+            case '"': escape = '"'; break;
+            case '\\': escape = '\\'; break;
+            case '\b': escape = 'b'; break;
+            case '\f': escape = 'f'; break;
+            case '\n': escape = 'n'; break;
+            case '\r': escape = 'r'; break;
+            case '\t': escape = 't'; break;
+            default: break;
+        }
+
+        if (escape) {
+            p = json_writer_reserve(writer, 2);
+            if (p) {
+                p[0] = '\\';
+                p[1] = escape;
+            }
+        } else if (c < 0x20) {
+            p = json_writer_reserve(writer, 6);
+            if (p) {
+                memcpy(p, "\\u00", 4);
+                p[4] = json_hex[c >> 4];
+                p[5] = json_hex[c & 0xF];
+            }
+        } else {
+            p = json_writer_reserve(writer, 1);
+            if (p) {
+                *p = (char)c;
+            }
+        }
+    }
+    json_writer_raw(writer, "\"", 1);
+}
+
+void json_writer_int(json_writer_t* writer, int64_t value)
+{
+    /* Digits are produced backwards, 20 covers INT64_MIN with its sign */
+    char digits[20];
+    size_t n = sizeof(digits);
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+    do {
+        digits[--n] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0) {
+        digits[--n] = '-';
+    }
+    json_writer_raw(writer, digits + n, sizeof(digits) - n);
+}
+
+void json_writer_bool(json_writer_t* writer, bool value)
+{
+    if (value) {
+        json_writer_raw(writer, "true", 4);
+    } else {
+        json_writer_raw(writer, "false", 5);
+    }
+}
+
+void json_writer_base64(json_writer_t* writer, const uint8_t* data, size_t length)
+{
+    size_t i;
+
+    json_writer_raw(writer, "\"", 1);
+    for (i = 0; i < length; i += 3) {
+        uint32_t block = (uint32_t)data[i] << 16;
+        if (i + 1 < length) {
+            block |= (uint32_t)data[i + 1] << 8;
+        }
+        if (i + 2 < length) {
+            block |= data[i + 2];
+        }
+
+        char* p = json_writer_reserve(writer, 4);
+        if (p == NULL) {
+            return;
+        }
+        p[0] = json_base64[(block >> 18) & 0x3F];
+        p[1] = json_base64[(block >> 12) & 0x3F];
+        p[2] = i + 1 < length ? json_base64[(block >> 6) & 0x3F] : '=';
+        p[3] = i + 2 < length ? json_base64[block & 0x3F] : '=';
+    }
+    json_writer_raw(writer, "\"", 1);
+}
+
+int json_writer_finish(json_writer_t* writer)
+{
+    if (writer->overflow) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+    writer->buffer[writer->length] = '\0';
+    return (int)writer->length;
+}
@@ -0,0 +1,53 @@
+#ifndef _JSON_WRITER_H_
+#define _JSON_WRITER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Appends JSON tokens to a caller sized buffer, without printf and without
+ * allocating. Nothing is written past the end, a write that does not fit
+ * marks the writer overflowed and every later write is dropped, so a
+ * sequence of writes needs one check at json_writer_finish.
+ */
+typedef struct {
+    char* buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} json_writer_t;
+
+/* One byte of size is kept for the terminator */
+void json_writer_init(json_writer_t* writer, char* buffer, size_t size);
+
+void json_writer_raw(json_writer_t* writer, const char* data, size_t length);
+
+static inline void json_writer_literal(json_writer_t* writer, const char* str)
+{
+    json_writer_raw(writer, str, strlen(str));
+}
+
+/* Quoted and escaped, worst case 6 bytes per input byte plus the quotes */
+void json_writer_string(json_writer_t* writer, const char* str, size_t length);
+
+void json_writer_int(json_writer_t* writer, int64_t value);
+
+void json_writer_bool(json_writer_t* writer, bool value);
+
+/* Quoted base64 of data, 4 bytes per 3 input bytes plus the quotes */
+void json_writer_base64(json_writer_t* writer, const uint8_t* data, size_t length);
+
+/* NUL terminates, returns the length written or OPRT_EXCEED_UPPER_LIMIT */
+int json_writer_finish(json_writer_t* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+#include <string.h>
+#include "lzss_decoder.h"
+#include "tuya_error_code.h"
+#include "system_interface.h"
+
+typedef enum {
+    LZSS_STATE_TAG,
+    LZSS_STATE_LITERAL,
+    LZSS_STATE_INDEX,
+    LZSS_STATE_COUNT,
+} lzss_state_t;
+
+int lzss_decoder_init(lzss_decoder_t* dec, uint8_t window_sz2, uint8_t lookahead_sz2)
+{
+    if (window_sz2 < LZSS_WINDOW_SZ2_MIN || window_sz2 > LZSS_WINDOW_SZ2_MAX ||
+        lookahead_sz2 < 3 || lookahead_sz2 >= window_sz2) {
+        return OPRT_INVALID_PARM;
+    }
+
+    memset(dec, 0, sizeof(lzss_decoder_t));
+    /* References before the first byte read zeros, same as the encoder's empty history */
+    dec->window = system_calloc(1, 1 << window_sz2);
+    if (dec->window == NULL) {
+        return OPRT_MALLOC_FAILED;
+    }
+    dec->window_sz2 = window_sz2;
+    dec->lookahead_sz2 = lookahead_sz2;
+    dec->state = LZSS_STATE_TAG;
+    return OPRT_OK;
+}
+
+/* Hand out the window from the last flush up to end */
+static int lzss_decoder_flush(lzss_decoder_t* dec, uint32_t end, lzss_output_cb_t output_cb, void* user_data)
+{
+    int rt = OPRT_OK;
+
+    if (end > dec->flushed) {
+        rt = output_cb(dec->window + dec->flushed, end - dec->flushed, user_data);
+    }
+    dec->flushed = dec->head;
+    return rt;
+}
+
+static int lzss_decoder_put(lzss_decoder_t* dec, uint8_t c, lzss_output_cb_t output_cb, void* user_data)
+{
+    dec->window[dec->head] = c;
+    dec->head = (dec->head + 1) & ((1 << dec->window_sz2) - 1);
+    dec->total++;
+    if (dec->head == 0) {
+        /* The window is about to be overwritten from the start */
+        return lzss_decoder_flush(dec, 1 << dec->window_sz2, output_cb, user_data);
+    }
+    return OPRT_OK;
+}
+
+int lzss_decoder_feed(lzss_decoder_t* dec, const uint8_t* input, size_t ilen,
+                      lzss_output_cb_t output_cb, void* user_data)
+{
+    if (dec == NULL || dec->window == NULL || (input == NULL && ilen)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    uint16_t mask = (1 << dec->window_sz2) - 1;
+    size_t i = 0;
+    int rt = OPRT_OK;
+
+    for (;;) {
+        uint8_t need = 0;
+        switch (dec->state) {
+        case LZSS_STATE_TAG:     need = 1; break;
+        case LZSS_STATE_LITERAL: need = 8; break;
+        case LZSS_STATE_INDEX:   need = dec->window_sz2; break;
+        case LZSS_STATE_COUNT:   need = dec->lookahead_sz2; break;
+        default: return OPRT_COM_ERROR;
+        }
+
+        while (dec->bit_count < need && i < ilen) {
+            dec->bits = (dec->bits << 8) | input[i++];
+            dec->bit_count += 8;
+        }
+        if (dec->bit_count < need) {
+            break;
+        }
+        dec->bit_count -= need;
+        uint16_t value = (dec->bits >> dec->bit_count) & ((1 << need) - 1);
+
+        switch (dec->state) {
+        case LZSS_STATE_TAG:
+            dec->state = value ? LZSS_STATE_LITERAL : LZSS_STATE_INDEX;
+            break;
+
+        case LZSS_STATE_LITERAL:
+            rt = lzss_decoder_put(dec, (uint8_t)value, output_cb, user_data);
+            dec->state = LZSS_STATE_TAG;
+            break;
+
+        case LZSS_STATE_INDEX:
+            dec->index = value + 1;
+            dec->state = LZSS_STATE_COUNT;
+            break;
+
+        case LZSS_STATE_COUNT: {
+            /* Byte by byte, so a reference may overlap the bytes it produces */
+            uint16_t count = value + 1;
+            while (count-- && rt == OPRT_OK) {
+                rt = lzss_decoder_put(dec, dec->window[(dec->head - dec->index) & mask], output_cb, user_data);
+            }
+            dec->state = LZSS_STATE_TAG;
+            break;
+        }
+        }
+
+        if (rt != OPRT_OK) {
+            return rt;
+        }
+    }
+
+    return lzss_decoder_flush(dec, dec->head, output_cb, user_data);
+}
+
+void lzss_decoder_free(lzss_decoder_t* dec)
+{
+    if (dec->window) {
+        system_free(dec->window);
+        dec->window = NULL;
+    }
+}
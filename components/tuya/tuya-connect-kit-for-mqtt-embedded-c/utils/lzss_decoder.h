@@ -0,0 +1,50 @@
+#ifndef _LZSS_DECODER_H_
+#define _LZSS_DECODER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Streaming LZSS decoder for the heatshrink bitstream: a 1 tag bit per
+ * token, 1 for an 8 bit literal, 0 for a back reference of window_sz2
+ * bits (distance - 1) followed by lookahead_sz2 bits (length - 1). Bits
+ * are read MSB first. RAM is one 2^window_sz2 byte window.
+ */
+#define LZSS_WINDOW_SZ2_MIN     (4)
+#define LZSS_WINDOW_SZ2_MAX     (14)
+
+typedef int (*lzss_output_cb_t)(const uint8_t* data, size_t len, void* user_data);
+
+typedef struct {
+    uint8_t window_sz2;
+    uint8_t lookahead_sz2;
+    uint8_t state;
+    uint8_t bit_count;
+    uint32_t bits;
+    uint16_t index;
+    uint16_t head;
+    uint16_t flushed;
+    uint8_t* window;
+    size_t total;
+} lzss_decoder_t;
+
+int lzss_decoder_init(lzss_decoder_t* dec, uint8_t window_sz2, uint8_t lookahead_sz2);
+
+/**
+ * Decode input, the output is handed to output_cb in runs of at most one
+ * window as it is produced. Input may be split at any byte.
+ */
+int lzss_decoder_feed(lzss_decoder_t* dec, const uint8_t* input, size_t ilen,
+                      lzss_output_cb_t output_cb, void* user_data);
+
+void lzss_decoder_free(lzss_decoder_t* dec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
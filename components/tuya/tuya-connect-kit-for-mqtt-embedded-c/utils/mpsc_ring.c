@@ -0,0 +1,78 @@
+#include <string.h>
+#include <stdbool.h>
+#include "mpsc_ring.h"
+#include "tuya_error_code.h"
+#include "system_interface.h"
+
+int mpsc_ring_init(mpsc_ring_t* ring, uint32_t capacity)
+{
+    if (ring == NULL || capacity < 2 || (capacity & (capacity - 1))) {
+        return OPRT_INVALID_PARM;
+    }
+
+    memset(ring, 0, sizeof(mpsc_ring_t));
+    ring->cells = system_calloc(capacity, sizeof(mpsc_ring_cell_t));
+    if (ring->cells == NULL) {
+        return OPRT_MALLOC_FAILED;
+    }
+    ring->mask = capacity - 1;
+
+    /* Slot i is free for the producer of position i */
+    uint32_t i;
+    for (i = 0; i < capacity; i++) {
+        ring->cells[i].seq = i;
+    }
+    return OPRT_OK;
+}
+
+int mpsc_ring_push(mpsc_ring_t* ring, void* data)
+{
+    uint32_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    mpsc_ring_cell_t* cell;
+
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        int32_t dif = (int32_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+        if (dif == 0) {
+            /* The slot is free, claim the position; on failure pos is reloaded */
+            if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            /* Still holds the entry of the previous lap */
+            return OPRT_EXCEED_UPPER_LIMIT;
+        } else {
+            /* Another producer took it first */
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->data = data;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return OPRT_OK;
+}
+
+void* mpsc_ring_pop(mpsc_ring_t* ring)
+{
+    uint32_t pos = ring->head;
+    mpsc_ring_cell_t* cell = &ring->cells[pos & ring->mask];
+
+    /* Empty, or the producer of this slot has not published it yet */
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return NULL;
+    }
+
+    void* data = cell->data;
+    __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    ring->head = pos + 1;
+    return data;
+}
+
+void mpsc_ring_free(mpsc_ring_t* ring)
+{
+    if (ring->cells) {
+        system_free(ring->cells);
+        ring->cells = NULL;
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef _MPSC_RING_H_
+#define _MPSC_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Bounded lock-free queue of pointers, any number of tasks may push while
+ * a single task pops. Every slot carries a sequence number telling whose
+ * turn it is, producers claim a slot with one compare-and-swap and never
+ * block each other or the consumer.
+ */
+typedef struct {
+    uint32_t seq;
+    void* data;
+} mpsc_ring_cell_t;
+
+typedef struct {
+    mpsc_ring_cell_t* cells;
+    uint32_t mask;
+    uint32_t head;
+    uint32_t tail;
+} mpsc_ring_t;
+
+/* capacity has to be a power of two */
+int mpsc_ring_init(mpsc_ring_t* ring, uint32_t capacity);
+
+/* Any task, returns OPRT_EXCEED_UPPER_LIMIT when the ring is full. */
+int mpsc_ring_push(mpsc_ring_t* ring, void* data);
+
+/* Consumer task only, NULL when the ring is empty. */
+void* mpsc_ring_pop(mpsc_ring_t* ring);
+
+void mpsc_ring_free(mpsc_ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #include <string.h>
 #include "esp_log.h"
 #include "tuya_iot.h"
+#include "tuya_ota.h"
 #include "tuya_wifi_provisioning.h"
 #include "qrcode.h"
 
@@ -13,14 +14,17 @@ TaskHandle_t tuya_main_task_handle = NULL;
 TaskHandle_t tuya_ble_pairing_task_handle = NULL;
 
 static tuya_iot_client_t client = {0};
+static tuya_ota_handle_t ota_handle = {0};
 static tuya_event_id_t last_event = TUYA_EVENT_RESET;
 static uint8_t new_event = 0;
+static uint8_t ota_restart_pending = 0;
 
 static void tuya_link_app_task(void *pvParameters);
 static void tuya_user_event_handler_on(tuya_iot_client_t *client, tuya_event_msg_t *event);
 static void tuya_qrcode_print(const char *productkey, const char *uuid);
+static void tuya_ota_event_handler_on(tuya_ota_handle_t *handle, tuya_ota_event_t *event);
 
-void tuya_dp_download(tuya_iot_client_t *client, const char *json_dps);
+void tuya_dp_download(tuya_iot_client_t *client, const tuya_dp_t *dp);
 uint8_t tuya_wait_event(tuya_event_id_t event, uint32_t timeout);
 void tuya_wifi_info_cb(wifi_info_t wifi_info);
 void hardware_switch_set(bool value);
@@ -141,11 +145,19 @@ static void tuya_link_app_task(void *pvParameters)
         .uuid = app_cfg.tuya.uuid,
         .authkey = app_cfg.tuya.auth_key,
         .storage_namespace = "tuya",
-        .event_handler = tuya_user_event_handler_on};
+        .event_handler = tuya_user_event_handler_on,
+        .dp_receive_typed = true};
 
     ret = tuya_iot_init(&client, &config);
 
     assert(ret == OPRT_OK);
+
+    /* Firmware is streamed straight into the next OTA partition */
+    tuya_ota_init(&ota_handle, &(const tuya_ota_config_t){
+                                   .client = &client,
+                                   .event_cb = tuya_ota_event_handler_on,
+                                   .sink_enable = true});
+
     tuya_iot_start(&client);
 
     if (app_cfg.pairing_state == PAIRING_BLE_PAIRING)
@@ -160,6 +172,13 @@ static void tuya_link_app_task(void *pvParameters)
     for (;;)
     {
         tuya_iot_yield(&client);
+
+        if (ota_restart_pending)
+        {
+            ESP_LOGI(TAG, "restarting into the new firmware...");
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            esp_restart();
+        }
     }
 }
 
@@ -179,10 +198,21 @@ static void tuya_user_event_handler_on(tuya_iot_client_t *client, tuya_event_msg
         ESP_LOGI(TAG, "device MQTT connected");
         break;
 
-    case TUYA_EVENT_DP_RECEIVE:
-        ESP_LOGI(TAG, "dp receive");
-        tuya_dp_download(client, (const char *)event->value.asString);
+    case TUYA_EVENT_DP_RECEIVE_VALUE:
+        tuya_dp_download(client, event->value.asDP);
+        break;
+
+    case TUYA_EVENT_UPGRADE_NOTIFY:
+    {
+        cJSON *version = cJSON_GetObjectItem(event->value.asJSON, "version");
+        ESP_LOGI(TAG, "upgrade to version %s", cJSON_IsString(version) ? version->valuestring : "unknown");
+        /* Refused while an upgrade is already downloading */
+        if (tuya_ota_begin(&ota_handle, event->value.asJSON) != OPRT_OK)
+        {
+            ESP_LOGW(TAG, "upgrade not started");
+        }
         break;
+    }
 
     case TUYA_EVENT_RESET:
         ESP_LOGI(TAG, "reset");
@@ -203,32 +233,60 @@ static void tuya_user_event_handler_on(tuya_iot_client_t *client, tuya_event_msg
     last_event = event->id;
 }
 
-void tuya_dp_download(tuya_iot_client_t *client, const char *json_dps)
+/* Tuya OTA event callback */
+static void tuya_ota_event_handler_on(tuya_ota_handle_t *handle, tuya_ota_event_t *event)
 {
-    ESP_LOGI(TAG, "data point download value: %s", json_dps);
-
-    cJSON *dps = cJSON_Parse(json_dps);
-    if (dps == NULL)
+    switch (event->id)
     {
-        ESP_LOGE(TAG, "JSON parsing error, exit");
+    case TUYA_OTA_EVENT_START:
+        ESP_LOGI(TAG, "ota start, size: %d", event->file_size);
+        break;
 
-        return;
+    case TUYA_OTA_EVENT_FINISH:
+        /* Restart from the main loop, after the upgrade status has been reported */
+        ESP_LOGI(TAG, "ota finished");
+        ota_restart_pending = 1;
+        break;
+
+    case TUYA_OTA_EVENT_FAULT:
+        ESP_LOGE(TAG, "ota failed");
+        break;
+
+    default:
+        break;
     }
+}
+
+void tuya_dp_download(tuya_iot_client_t *client, const tuya_dp_t *dp)
+{
+    ESP_LOGI(TAG, "data point download id: %d", dp->id);
 
     // TODO: Here you can write your own logic
 
-    cJSON *switch_obj = cJSON_GetObjectItem(dps, "101");
-    if (cJSON_IsTrue(switch_obj))
-    {
-        hardware_switch_set(true);
-    }
-    else if (cJSON_IsFalse(switch_obj))
+    switch (dp->id)
     {
-        hardware_switch_set(false);
+    case 101:
+        if (dp->type != TUYA_DP_TYPE_BOOL)
+        {
+            break;
+        }
+        hardware_switch_set(dp->value.asBool);
+        if (tuya_iot_dp_set_bool(client, 101, dp->value.asBool) == OPRT_OK)
+        {
+            tuya_iot_dp_report(client);
+        }
+        else
+        {
+            /* No product schema yet */
+            tuya_iot_dp_report_values(client, dp, 1);
+        }
+        return;
+
+    default:
+        break;
     }
 
-    cJSON_Delete(dps);
-    tuya_iot_dp_report_json(client, json_dps);
+    ESP_LOGW(TAG, "unsupported data point %d type %d", dp->id, dp->type);
 }
 
 void tuya_wifi_info_cb(wifi_info_t wifi_info)
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""Build compressed and delta OTA images for the Tuya OTA pipeline.
+
+    ota_image.py compress new.bin -o new.lz
+    ota_image.py delta old.bin new.bin -o new.patch [--compress]
+
+Compressed images are announced with "compress":"lzss" in the upgrade
+message and delta images with "delta":true, see tuya_ota.h and
+ota_delta.h for the formats. md5/sha256 are those of the output file.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+LZSS_MAGIC = b"TYLZ"
+DELTA_MAGIC = b"TYDP"
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.count = 0
+
+    def put(self, value, bits):
+        self.acc = (self.acc << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.out.append((self.acc >> self.count) & 0xFF)
+        self.acc &= (1 << self.count) - 1
+
+    def flush(self):
+        # Zero padding is shorter than any back reference, the decoder drops it
+        if self.count:
+            self.out.append((self.acc << (8 - self.count)) & 0xFF)
+            self.count = 0
+        return bytes(self.out)
+
+
+def lzss_compress(data, window_sz2, lookahead_sz2, depth=32):
+    window = 1 << window_sz2
+    max_len = 1 << lookahead_sz2
+    bits = BitWriter()
+    chains = {}
+    i = 0
+    while i < len(data):
+        best_len, best_dist = 0, 0
+        key = data[i:i + 3]
+        limit = min(max_len, len(data) - i)
+        for j in reversed(chains.get(key, [])[-depth:]):
+            if i - j > window:
+                break
+            n = 0
+            while n < limit and data[j + n] == data[i + n]:
+                n += 1
+            if n > best_len:
+                best_len, best_dist = n, i - j
+                if n == limit:
+                    break
+
+        if best_len * 9 > 1 + window_sz2 + lookahead_sz2:
+            bits.put(0, 1)
+            bits.put(best_dist - 1, window_sz2)
+            bits.put(best_len - 1, lookahead_sz2)
+            step = best_len
+        else:
+            bits.put(1, 1)
+            bits.put(data[i], 8)
+            step = 1
+
+        for k in range(i, i + step):
+            chains.setdefault(data[k:k + 3], []).append(k)
+        i += step
+
+    header = LZSS_MAGIC + bytes([window_sz2, lookahead_sz2, 0, 0]) + struct.pack("<I", len(data))
+    return header + bits.flush()
+
+
+def delta_extend(old, j, new, i):
+    """Length of the approximate match at old[j], new[i], and its score."""
+    score, best_score, best_len = 0, 0, 0
+    k = 0
+    while j + k < len(old) and i + k < len(new):
+        score += 1 if old[j + k] == new[i + k] else -1
+        if score > best_score:
+            best_score, best_len = score, k + 1
+        elif score < best_score - 16:
+            break
+        k += 1
+    return best_len, best_score
+
+
+def delta_make(old, new, key_len=8, min_score=12):
+    index = {}
+    for j in range(len(old) - key_len + 1):
+        index.setdefault(old[j:j + key_len], j)
+
+    # Approximate matches (new pos, old pos, length), mismatches become add bytes
+    matches = []
+    align = 0
+    i = 0
+    while i < len(new):
+        best = None
+        for j in (i + align, index.get(new[i:i + key_len])):
+            if j is None or j < 0 or j >= len(old):
+                continue
+            length, score = delta_extend(old, j, new, i)
+            if score >= min_score and (best is None or score > best[2]):
+                best = (j, length, score)
+        if best is None:
+            i += 1
+            continue
+        matches.append((i, best[0], best[1]))
+        align = best[0] - i
+        i += best[1]
+
+    out = bytearray()
+    header = DELTA_MAGIC + struct.pack("<III", len(old), zlib.crc32(old), len(new))
+    out += header
+
+    first_new, first_old = (matches[0][0], matches[0][1]) if matches else (len(new), 0)
+    out += struct.pack("<IIi", 0, first_new, first_old)
+    out += new[:first_new]
+
+    for k, (i, j, length) in enumerate(matches):
+        next_new, next_old = (matches[k + 1][0], matches[k + 1][1]) if k + 1 < len(matches) else (len(new), j + length)
+        out += struct.pack("<IIi", length, next_new - i - length, next_old - j - length)
+        out += bytes((new[i + t] - old[j + t]) & 0xFF for t in range(length))
+        out += new[i + length:next_new]
+    return bytes(out)
+
+
+def delta_apply(old, patch):
+    magic, source_size, source_crc, image_size = struct.unpack_from("<4sIII", patch)
+    assert magic == DELTA_MAGIC and source_size == len(old) and source_crc == zlib.crc32(old)
+    new = bytearray()
+    pos, src = 16, 0
+    while len(new) < image_size:
+        add, extra, seek = struct.unpack_from("<IIi", patch, pos)
+        pos += 12
+        new += bytes((patch[pos + t] + old[src + t]) & 0xFF for t in range(add))
+        pos += add
+        src += add
+        new += patch[pos:pos + extra]
+        pos += extra
+        src += seek
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    compress = sub.add_parser("compress", help="LZSS compress a firmware image")
+    compress.add_argument("image")
+
+    delta = sub.add_parser("delta", help="patch from the running firmware to a new one")
+    delta.add_argument("old")
+    delta.add_argument("image")
+    delta.add_argument("--compress", action="store_true", help="LZSS compress the patch as well")
+
+    for p in (compress, delta):
+        p.add_argument("-o", "--output", required=True)
+        p.add_argument("--window", type=int, default=11, help="LZSS window bits, 4..14")
+        p.add_argument("--lookahead", type=int, help="LZSS length bits, 3..window-1")
+    args = parser.parse_args()
+
+    # Patches are mostly long runs of zero add bytes, longer matches pay off
+    if args.lookahead is None:
+        args.lookahead = 8 if args.command == "delta" else 4
+
+    if not 4 <= args.window <= 14 or not 3 <= args.lookahead < args.window:
+        parser.error("window must be 4..14 and lookahead 3..window-1")
+
+    image = open(args.image, "rb").read()
+    if args.command == "delta":
+        old = open(args.old, "rb").read()
+        data = delta_make(old, image)
+        assert delta_apply(old, data) == image
+        if args.compress:
+            data = lzss_compress(data, args.window, args.lookahead)
+    else:
+        data = lzss_compress(image, args.window, args.lookahead)
+
+    with open(args.output, "wb") as f:
+        f.write(data)
+
+    print("%s: %d -> %d bytes (%.1f%%)" % (args.output, len(image), len(data), 100.0 * len(data) / max(len(image), 1)))
+    print("md5:    %s" % hashlib.md5(data).hexdigest())
+    print("sha256: %s" % hashlib.sha256(data).hexdigest())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
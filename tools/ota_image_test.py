@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Round trip ota_image.py output through the C OTA image pipeline.
+
+    ota_image_test.py path/to/ota_image_check
+
+Builds firmware-like image pairs, makes compressed, delta and compressed
+delta files of them with ota_image.py, and has ota_image_check (the
+examples/ota_image_check host target of the SDK) rebuild the new image
+with lzss_decoder_feed and ota_delta_feed.
+"""
+
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+TOOL = os.path.join(os.path.dirname(os.path.abspath(__file__)), "ota_image.py")
+
+
+def firmware(rng, size):
+    """Code-like bytes: repeated instruction patterns with varying operands."""
+    ops = [bytes(rng.randrange(256) for _ in range(rng.choice((2, 3, 4)))) for _ in range(64)]
+    out = bytearray()
+    while len(out) < size:
+        out += rng.choice(ops)
+        if rng.random() < 0.3:
+            out += rng.randrange(1 << 16).to_bytes(2, "little")
+    return bytes(out[:size])
+
+
+def revise(rng, old):
+    """A new build: code inserted and removed, constants and addresses changed."""
+    new = bytearray(old)
+    for _ in range(8):
+        at = rng.randrange(len(new))
+        new[at:at] = firmware(rng, rng.randrange(16, 512))
+    for _ in range(4):
+        at = rng.randrange(len(new))
+        del new[at:at + rng.randrange(16, 256)]
+    for _ in range(len(new) // 200):
+        new[rng.randrange(len(new))] = rng.randrange(256)
+    return bytes(new)
+
+
+def cases(rng):
+    old = firmware(rng, 64 * 1024)
+    yield "revised", old, revise(rng, old)
+    yield "identical", old, old
+    yield "unrelated", old, firmware(rng, 20 * 1024)
+    small = firmware(rng, 40)
+    yield "tiny", small, small[:17] + b"\x00" + small[17:]
+
+
+def run(args):
+    result = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    return result.returncode, result.stdout
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 2
+    checker = sys.argv[1]
+    rng = random.Random(1)
+    failures = 0
+
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, old, new in cases(rng):
+            old_path = os.path.join(tmp, name + ".old")
+            new_path = os.path.join(tmp, name + ".new")
+            with open(old_path, "wb") as f:
+                f.write(old)
+            with open(new_path, "wb") as f:
+                f.write(new)
+
+            variants = [
+                ("lz", ["compress", new_path], []),
+                ("patch", ["delta", old_path, new_path], [old_path]),
+                ("patch.lz", ["delta", old_path, new_path, "--compress"], [old_path]),
+                ("patch.lz6", ["delta", old_path, new_path, "--compress", "--window", "6", "--lookahead", "3"], [old_path]),
+            ]
+            for suffix, make, source in variants:
+                ota_path = os.path.join(tmp, "%s.%s" % (name, suffix))
+                code, out = run([sys.executable, TOOL] + make + ["-o", ota_path])
+                if code == 0:
+                    code, out = run([checker, ota_path, new_path] + source)
+                print("%-20s %s" % (name + "." + suffix, "ok" if code == 0 else "FAILED"))
+                if code != 0:
+                    print(out)
+                    failures += 1
+
+    print("%d failed" % failures if failures else "all passed")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())